@@ -0,0 +1,267 @@
+#define _CRT_SECURE_NO_WARNINGS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include "serverproto.h"
+
+// minijavac-client: sends compile requests to a running "minijavac --server <socket>"
+
+
+//////////////// connection ////////////////
+
+static SOCKET Connect(const char *path)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "ERROR : socket path too long.\n");
+		return INVALID_SOCKET;
+	}
+	strcpy(addr.sun_path, path);
+
+	SOCKET s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == INVALID_SOCKET) {
+		fprintf(stderr, "ERROR : Can't create AF_UNIX socket (%d), Windows 10 1803 or later is required.\n", WSAGetLastError());
+		return INVALID_SOCKET;
+	}
+	if (connect(s, (sockaddr *) &addr, sizeof(addr)) == SOCKET_ERROR) {
+		fprintf(stderr, "ERROR : Can't connect to %s (%d), is the server running?\n", path, WSAGetLastError());
+		closesocket(s);
+		return INVALID_SOCKET;
+	}
+	return s;
+}
+
+// sends one request and waits for its reply, returns false on connection errors
+static bool Request(SOCKET s, uint32_t type, const std::string &outbase, const std::string &payload, ServerReplyHeader &rep, std::string &log, std::string &outputs)
+{
+	ServerRequestHeader req = { SERVER_MAGIC, type, (uint32_t) outbase.size(), (uint32_t) payload.size() };
+	if (!ServerSendAll(s, &req, sizeof(req)) || !ServerSendAll(s, outbase.data(), outbase.size()) || !ServerSendAll(s, payload.data(), payload.size())) {
+		return false;
+	}
+	if (!ServerRecvAll(s, &rep, sizeof(rep)) || rep.magic != SERVER_MAGIC || rep.log_len > SERVER_MAX_PAYLOAD || rep.outputs_len > SERVER_MAX_PAYLOAD) {
+		return false;
+	}
+	log.resize(rep.log_len);
+	outputs.resize(rep.outputs_len);
+	return ServerRecvAll(s, &log[0], log.size()) && ServerRecvAll(s, &outputs[0], outputs.size());
+}
+
+static std::string FullPath(const char *path)
+{
+	char buf[MAX_PATH];
+	DWORD len = GetFullPathNameA(path, sizeof(buf), buf, NULL);
+	return len > 0 && len < sizeof(buf) ? std::string(buf, len) : std::string(path);
+}
+
+static bool ReadAll(FILE *fp, std::string &data)
+{
+	char buf[65536];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		data.append(buf, n);
+	}
+	return !ferror(fp);
+}
+
+
+//////////////// commands ////////////////
+
+static int Compile(const char *sock, const char *src, const char *outbase)
+{
+	// the server runs in its own directory, so paths are sent absolute
+	uint32_t type;
+	std::string payload;
+	if (strcmp(src, "-") == 0) {
+		type = SERVER_COMPILE_BUFFER;
+		if (!ReadAll(stdin, payload)) {
+			fprintf(stderr, "ERROR : Can't read source from stdin.\n");
+			return 1;
+		}
+	} else {
+		type = SERVER_COMPILE_FILE;
+		payload = FullPath(src);
+	}
+	std::string out = FullPath(outbase ? outbase : "out");
+
+	SOCKET s = Connect(sock);
+	if (s == INVALID_SOCKET) return 1;
+	ServerReplyHeader rep;
+	std::string log, outputs;
+	bool ok = Request(s, type, out, payload, rep, log, outputs);
+	closesocket(s);
+	if (!ok) {
+		fprintf(stderr, "ERROR : connection to server lost.\n");
+		return 1;
+	}
+	fwrite(log.data(), 1, log.size(), stdout);
+	if (!outputs.empty()) {
+		printf("[*] Output files:\n");
+		for (size_t p = 0, q; (q = outputs.find('\n', p)) != std::string::npos; p = q + 1) {
+			printf("  %s\n", outputs.substr(p, q - p).c_str());
+		}
+	}
+	return rep.error_count != 0;
+}
+
+static int Shutdown(const char *sock)
+{
+	SOCKET s = Connect(sock);
+	if (s == INVALID_SOCKET) return 1;
+	ServerReplyHeader rep;
+	std::string log, outputs;
+	bool ok = Request(s, SERVER_SHUTDOWN, "", "", rep, log, outputs);
+	closesocket(s);
+	if (!ok) {
+		fprintf(stderr, "ERROR : connection to server lost.\n");
+		return 1;
+	}
+	fwrite(log.data(), 1, log.size(), stdout);
+	return 0;
+}
+
+
+//////////////// benchmark ////////////////
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double Since(bench_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+static void Report(const char *name, std::vector<double> &ms)
+{
+	std::sort(ms.begin(), ms.end());
+	double sum = 0;
+	for (auto t: ms) sum += t;
+	printf("  %-6s n=%-4u min %8.3f  median %8.3f  p90 %8.3f  mean %8.3f  (ms)\n", name, (unsigned) ms.size(),
+		ms.front(), ms[ms.size() / 2], ms[ms.size() * 9 / 10], sum / ms.size());
+}
+
+// one cold invocation: a fresh minijavac process with empty arenas and caches
+static bool RunCold(const std::string &cmdline, const char *workdir)
+{
+	SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+	HANDLE nul = CreateFileA("NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+	STARTUPINFOA si;
+	memset(&si, 0, sizeof(si));
+	si.cb = sizeof(si);
+	si.dwFlags = STARTF_USESTDHANDLES;
+	si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+	si.hStdOutput = nul;
+	si.hStdError = nul;
+	PROCESS_INFORMATION pi;
+	std::vector<char> cmd(cmdline.begin(), cmdline.end());
+	cmd.push_back('\0');
+	bool ok = CreateProcessA(NULL, cmd.data(), NULL, NULL, TRUE, 0, NULL, workdir, &si, &pi) != 0;
+	if (ok) {
+		DWORD code = 1;
+		WaitForSingleObject(pi.hProcess, INFINITE);
+		GetExitCodeProcess(pi.hProcess, &code);
+		CloseHandle(pi.hThread);
+		CloseHandle(pi.hProcess);
+		ok = code == 0;
+	}
+	if (nul != INVALID_HANDLE_VALUE) CloseHandle(nul);
+	return ok;
+}
+
+static int Bench(const char *sock, const char *compiler, const char *src, int n)
+{
+	// both sides write their outputs into a scratch directory
+	char tmp[MAX_PATH];
+	GetTempPathA(sizeof(tmp), tmp);
+	std::string workdir = std::string(tmp) + "minijavac-bench";
+	CreateDirectoryA(workdir.c_str(), NULL);
+	std::string path = FullPath(src), out = workdir + "\\out";
+	std::string cmdline = "\"" + FullPath(compiler) + "\" \"" + path + "\"";
+
+	printf("[*] Benchmarking %s, %d requests each ...\n", path.c_str(), n);
+	fflush(stdout);
+
+	// warm: every request opens its own connection, like a build tool invoking the client would
+	std::vector<double> warm;
+	for (int i = 0; i < n; i++) {
+		auto start = bench_clock::now();
+		SOCKET s = Connect(sock);
+		if (s == INVALID_SOCKET) return 1;
+		ServerReplyHeader rep;
+		std::string log, outputs;
+		bool ok = Request(s, SERVER_COMPILE_FILE, out, path, rep, log, outputs);
+		closesocket(s);
+		if (!ok || rep.error_count != 0) {
+			fprintf(stderr, "ERROR : server request failed.\n");
+			return 1;
+		}
+		warm.push_back(Since(start));
+	}
+
+	std::vector<double> cold;
+	for (int i = 0; i < n; i++) {
+		auto start = bench_clock::now();
+		if (!RunCold(cmdline, workdir.c_str())) {
+			fprintf(stderr, "ERROR : %s failed.\n", cmdline.c_str());
+			return 1;
+		}
+		cold.push_back(Since(start));
+	}
+
+	Report("server", warm);
+	Report("cold", cold);
+	printf("[*] Median latency: server is %.2fx faster than a cold invocation.\n", cold[cold.size() / 2] / warm[warm.size() / 2]);
+	return 0;
+}
+
+
+//////////////// main ////////////////
+
+static void Usage()
+{
+	printf("usage:\n");
+	printf("  minijavac-client <socket> <source.java | -> [outbase]\n");
+	printf("  minijavac-client <socket> --shutdown\n");
+	printf("  minijavac-client <socket> --bench <minijavac.exe> <source.java> [n]\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		Usage();
+		return 1;
+	}
+
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+		fprintf(stderr, "ERROR : WSAStartup failed.\n");
+		return 1;
+	}
+
+	int ret;
+	if (strcmp(argv[2], "--shutdown") == 0) {
+		ret = Shutdown(argv[1]);
+	} else if (strcmp(argv[2], "--bench") == 0) {
+		if (argc < 5) {
+			Usage();
+			ret = 1;
+		} else {
+			ret = Bench(argv[1], argv[3], argv[4], argc > 5 ? std::max(1, atoi(argv[5])) : 20);
+		}
+	} else {
+		ret = Compile(argv[1], argv[2], argc > 3 ? argv[3] : NULL);
+	}
+
+	WSACleanup();
+	return ret;
+}
@@ -0,0 +1,459 @@
+#include "common.h"
+
+static const char ASTCACHE_MAGIC[8] = { 'M', 'J', 'A', 'S', 'T', 'C', 0, 0 };
+
+//////////////// ASTCache ////////////////
+
+ASTCache::ASTCache()
+{
+}
+ASTCache *ASTCache::Instance()
+{
+	static ASTCache inst;
+	return &inst;
+}
+
+uint64_t ASTCache::HashSource(const char *src, size_t len)
+{
+	// 64-bit FNV-1a
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < len; i++) {
+		h ^= (uint8_t) src[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+void ASTCache::SetDirectory(const char *dir)
+{
+	this->dir = dir;
+	CreateDirectoryA(dir, NULL);
+}
+bool ASTCache::Enabled()
+{
+	return !dir.empty();
+}
+std::string ASTCache::GetPath(uint64_t hash)
+{
+	char buf[32];
+	sprintf(buf, "%016llx.astc", (unsigned long long) hash);
+	return dir + "\\" + buf;
+}
+ASTCache::MappedImage::MappedImage() : file(INVALID_HANDLE_VALUE), mapping(NULL), view(nullptr), size(0)
+{
+}
+ASTCache::MappedImage::~MappedImage()
+{
+	Unmap();
+}
+bool ASTCache::MappedImage::Map(const std::string &path)
+{
+	Unmap();
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER fsize;
+	if (!GetFileSizeEx(file, &fsize) || fsize.QuadPart < (LONGLONG) sizeof(Header)) {
+		Unmap();
+		return false;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping) {
+		Unmap();
+		return false;
+	}
+	view = (const char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		Unmap();
+		return false;
+	}
+	size = (size_t) fsize.QuadPart;
+	return true;
+}
+void ASTCache::MappedImage::Unmap()
+{
+	if (view) UnmapViewOfFile(view);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+	view = nullptr;
+	size = 0;
+}
+
+// sequential reader of the ClassInfoList and annotation sections, reads past the end or bad indices only set the error flag
+class ASTCache::SectionReader {
+	const uint32_t *cur;
+	const uint32_t *end;
+	const FlatAST &flat;
+	const std::vector<ASTNode *> &order;
+public:
+	bool bad = false;
+public:
+	SectionReader(const uint32_t *ptr, size_t size, const FlatAST &flat, const std::vector<ASTNode *> &order)
+		: cur(ptr), end(ptr + size), flat(flat), order(order) {}
+	bool AtEnd() const { return cur == end; }
+	uint32_t Get()
+	{
+		if (cur == end) {
+			bad = true;
+			return 0;
+		}
+		return *cur++;
+	}
+	Symbol GetSymbol()
+	{
+		uint32_t i = Get();
+		if (i >= flat.symbols.size()) {
+			bad = true;
+			return Symbol();
+		}
+		return flat.symbols[i];
+	}
+	TypeInfo GetTypeInfo()
+	{
+		TypeInfo t;
+		uint32_t type = Get();
+		if (type > ASTType::VT_CLASS) bad = true;
+		t.type = bad ? ASTType::VT_UNKNOWN : (ASTType::VarType) type;
+		t.clsname = GetSymbol();
+		return t;
+	}
+	VarDeclList GetVarDeclList()
+	{
+		VarDeclList list;
+		uint32_t cnt = Get();
+		for (uint32_t i = 0; i < cnt && !bad; i++) {
+			VarDeclItem item;
+			item.decl.type = GetTypeInfo();
+			item.decl.name = GetSymbol();
+			item.off = (data_off_t) Get();
+			item.size = (data_off_t) Get();
+			if (item.off % 4 != 0 || item.size <= 0 || item.size % 4 != 0) bad = true;
+			list.Append(item);
+		}
+		return list;
+	}
+	ASTMethodDeclaration *GetMethodNode()
+	{
+		uint32_t id = Get();
+		if (id >= order.size() || !order[id]->Is<ASTMethodDeclaration>()) {
+			bad = true;
+			return nullptr;
+		}
+		return &order[id]->As<ASTMethodDeclaration>();
+	}
+	// what an identifier refers to, as positions in the loaded ClassInfoList
+	void GetBinding(ASTIdentifier &ident, const ClassInfoList &list)
+	{
+		uint32_t kind = Get(), cls = Get(), member = Get(), var = Get();
+		ident.declkind = ASTIdentifier::DECL_NONE;
+		ident.var = nullptr;
+		ident.slot_off = (data_off_t) Get();
+		ident.slot_size = (data_off_t) Get();
+		if (bad || kind > ASTIdentifier::DECL_CLASS) {
+			bad = true;
+			return;
+		}
+		if (kind == ASTIdentifier::DECL_NONE) return;
+		if (cls >= list.size()) {
+			bad = true;
+			return;
+		}
+		const ClassInfoItem &c = list[cls];
+		const VarDeclList *vars = &c.var;
+		if (kind == ASTIdentifier::DECL_LOCAL || kind == ASTIdentifier::DECL_ARG || kind == ASTIdentifier::DECL_METHOD) {
+			if (member >= c.method.size()) {
+				bad = true;
+				return;
+			}
+			const MethodDeclItem &m = c.method[member];
+			vars = kind == ASTIdentifier::DECL_LOCAL ? &m.localvar : &m.decl.arg;
+			if (kind == ASTIdentifier::DECL_METHOD) ident.method = &m;
+		}
+		if (kind == ASTIdentifier::DECL_CLASS) {
+			ident.cls = &c;
+		} else if (kind != ASTIdentifier::DECL_METHOD) {
+			if (var >= vars->size() || ident.slot_off % 4 != 0 || ident.slot_size != (*vars)[var].size) {
+				bad = true;
+				return;
+			}
+			ident.var = &(*vars)[var];
+		}
+		ident.declkind = (ASTIdentifier::DeclKind) kind;
+	}
+};
+
+// true if [off, off + size) lies inside the image and off is aligned for the section's element type
+static bool IsValidSection(uint64_t off, uint64_t size, uint64_t align, uint64_t image_size)
+{
+	return off % align == 0 && off <= image_size && size <= image_size - off;
+}
+
+bool ASTCache::Load(uint64_t hash, size_t srclen, ASTGoal *&goal, ClassInfoList &clsinfo)
+{
+	MappedImage img;
+	if (!img.Map(GetPath(hash))) {
+		return false;
+	}
+
+	const char *view = img.view;
+	uint64_t view_size = img.size;
+	const Header *h = (const Header *) view;
+	uint64_t n = h->node_count;
+	if (memcmp(h->magic, ASTCACHE_MAGIC, sizeof(ASTCACHE_MAGIC)) != 0 || h->version != VERSION
+		|| h->src_hash != hash || h->src_size != srclen || h->file_size != view_size
+		|| n == 0 || h->symbol_count == 0
+		|| !IsValidSection(h->off_kind, n * sizeof(ASTNodeKind), sizeof(ASTNodeKind), view_size)
+		|| !IsValidSection(h->off_loc, n * sizeof(yyltype), sizeof(int), view_size)
+		|| !IsValidSection(h->off_first, (n + 1) * sizeof(FlatAST::NodeId), sizeof(FlatAST::NodeId), view_size)
+		|| !IsValidSection(h->off_data, n * sizeof(uint32_t), sizeof(uint32_t), view_size)
+		|| !IsValidSection(h->off_clsinfo, (uint64_t) h->clsinfo_size * sizeof(uint32_t), sizeof(uint32_t), view_size)
+		|| !IsValidSection(h->off_annot, (uint64_t) h->annot_size * sizeof(uint32_t), sizeof(uint32_t), view_size)
+		|| !IsValidSection(h->off_symbol, 0, sizeof(uint32_t), h->off_clsinfo)
+		|| HashSource(view + sizeof(Header), (size_t) (view_size - sizeof(Header))) != h->data_hash) {
+		return false;
+	}
+
+	// symbol names run from off_symbol up to the ClassInfoList section
+	std::vector<Symbol> symbols;
+	symbols.reserve(h->symbol_count);
+	uint64_t p = h->off_symbol;
+	for (uint32_t i = 0; i < h->symbol_count; i++) {
+		uint32_t len;
+		if (h->off_clsinfo - p < sizeof(len)) {
+			return false;
+		}
+		memcpy(&len, view + p, sizeof(len));
+		p += sizeof(len);
+		if (h->off_clsinfo - p < len) {
+			return false;
+		}
+		symbols.push_back(i ? Symbol(view + p, len) : Symbol());
+		if (i && symbols.back().empty()) {
+			return false; // an empty name, or the SymbolTable is full
+		}
+		p += std::min<uint64_t>((len + 3ULL) & ~3ULL, h->off_clsinfo - p);
+	}
+
+	FlatAST flat;
+	flat.Attach(n,
+		(const ASTNodeKind *) (view + h->off_kind),
+		(const yyltype *) (view + h->off_loc),
+		(const FlatAST::NodeId *) (view + h->off_first),
+		(const uint32_t *) (view + h->off_data),
+		std::move(symbols));
+	if (!flat.Validate() || flat.kind[FlatAST::ROOT] != ASTNodeKind::ASTGoal) {
+		return false;
+	}
+
+	std::vector<ASTNode *> order;
+	ASTNode *root = flat.Inflate(&order);
+
+	// ClassInfoList, in the order Save() wrote it
+	SectionReader r((const uint32_t *) (view + h->off_clsinfo), h->clsinfo_size, flat, order);
+	ClassInfoList list;
+	uint32_t ncls = r.Get();
+	for (uint32_t i = 0; i < ncls && !r.bad; i++) {
+		ClassInfoItem cls;
+		cls.name = r.GetSymbol();
+		cls.base = r.GetSymbol();
+		cls.var = r.GetVarDeclList();
+		uint32_t nmethod = r.Get();
+		for (uint32_t j = 0; j < nmethod && !r.bad; j++) {
+			MethodDeclItem method;
+			method.decl.rettype = r.GetTypeInfo();
+			method.decl.name = r.GetSymbol();
+			method.decl.arg = r.GetVarDeclList();
+			method.off = (data_off_t) r.Get();
+			if (method.off % 4 != 0) r.bad = true;
+			method.localvar = r.GetVarDeclList();
+			method.clsname = r.GetSymbol();
+			method.ptr = r.GetMethodNode();
+			cls.method.Append(method);
+		}
+		list.Append(cls);
+	}
+	if (r.bad || !r.AtEnd()) {
+		return false;
+	}
+
+	// the annotations, in node order, resolved against the list before it is moved out,
+	// moving it keeps every item where it is
+	SectionReader a((const uint32_t *) (view + h->off_annot), h->annot_size, flat, order);
+	for (size_t id = 0; id < order.size() && !a.bad; id++) {
+		if (!order[id]->Is<ASTExpression>()) continue;
+		order[id]->As<ASTExpression>().SetTypeInfo(a.GetTypeInfo());
+		if (order[id]->Is<ASTIdentifier>()) {
+			a.GetBinding(order[id]->As<ASTIdentifier>(), list);
+		}
+	}
+	if (a.bad || !a.AtEnd()) {
+		return false;
+	}
+	goal = &root->As<ASTGoal>();
+	clsinfo = std::move(list);
+	return true;
+}
+
+static uint64_t AppendSection(std::vector<char> &image, const void *ptr, size_t size)
+{
+	image.resize((image.size() + 7) & ~7);
+	uint64_t off = image.size();
+	image.insert(image.end(), (const char *) ptr, (const char *) ptr + size);
+	return off;
+}
+
+bool ASTCache::Save(uint64_t hash, size_t srclen, ASTGoal *goal, size_t nodecount, ClassInfoList &clsinfo)
+{
+	FlatAST out;
+	std::vector<ASTNode *> order;
+	out.Build(goal, &order, nodecount);
+
+	std::unordered_map<ASTNode *, uint32_t> method_id;
+	for (size_t id = 0; id < order.size(); id++) {
+		if (order[id]->Is<ASTMethodDeclaration>()) {
+			method_id[order[id]] = (uint32_t) id;
+		}
+	}
+
+	std::vector<uint32_t> cls;
+	auto PutSymbol = [&](Symbol s) {
+		cls.push_back(out.GetSymbolIndex(s));
+	};
+	auto PutTypeInfo = [&](const TypeInfo &t) {
+		cls.push_back((uint32_t) t.type);
+		PutSymbol(t.clsname);
+	};
+	auto PutVarDeclList = [&](const VarDeclList &list) {
+		cls.push_back((uint32_t) list.size());
+		for (auto &item: list) {
+			PutTypeInfo(item.decl.type);
+			PutSymbol(item.decl.name);
+			cls.push_back((uint32_t) item.off);
+			cls.push_back((uint32_t) item.size);
+		}
+	};
+	cls.push_back((uint32_t) clsinfo.size());
+	for (auto &c: clsinfo) {
+		PutSymbol(c.name);
+		PutSymbol(c.base);
+		PutVarDeclList(c.var);
+		cls.push_back((uint32_t) c.method.size());
+		for (auto &m: c.method) {
+			PutTypeInfo(m.decl.rettype);
+			PutSymbol(m.decl.name);
+			PutVarDeclList(m.decl.arg);
+			cls.push_back((uint32_t) m.off);
+			PutVarDeclList(m.localvar);
+			PutSymbol(m.clsname);
+			cls.push_back(method_id.at(m.ptr));
+		}
+	}
+
+	// what TypeCheck stored on the expressions, in node order, with the items identifiers refer to
+	// as positions in the ClassInfoList, an item shared by a base and a derived class is recorded in the base
+	struct ItemPos {
+		uint32_t cls, member, var;
+	};
+	std::unordered_map<const void *, ItemPos> item_pos;
+	for (uint32_t ci = 0; ci < clsinfo.size(); ci++) {
+		const ClassInfoItem &c = clsinfo[ci];
+		item_pos.emplace(&c, ItemPos { ci, 0, 0 });
+		for (uint32_t vi = 0; vi < c.var.size(); vi++) {
+			item_pos.emplace(&c.var[vi], ItemPos { ci, 0, vi });
+		}
+		for (uint32_t mi = 0; mi < c.method.size(); mi++) {
+			const MethodDeclItem &m = c.method[mi];
+			item_pos.emplace(&m, ItemPos { ci, mi, 0 });
+			for (uint32_t vi = 0; vi < m.decl.arg.size(); vi++) {
+				item_pos.emplace(&m.decl.arg[vi], ItemPos { ci, mi, vi });
+			}
+			for (uint32_t vi = 0; vi < m.localvar.size(); vi++) {
+				item_pos.emplace(&m.localvar[vi], ItemPos { ci, mi, vi });
+			}
+		}
+	}
+	std::vector<uint32_t> annot;
+	for (ASTNode *node: order) {
+		if (!node->Is<ASTExpression>()) continue;
+		ASTExpression &expr = node->As<ASTExpression>();
+		annot.push_back(expr.restype);
+		annot.push_back(out.GetSymbolIndex(expr.resclsname));
+		if (!node->Is<ASTIdentifier>()) continue;
+		ASTIdentifier &ident = node->As<ASTIdentifier>();
+		const void *item = nullptr;
+		switch (ident.declkind) {
+			case ASTIdentifier::DECL_NONE:   break;
+			case ASTIdentifier::DECL_METHOD: item = ident.method; break;
+			case ASTIdentifier::DECL_CLASS:  item = ident.cls; break;
+			default:                         item = ident.var; break;
+		}
+		ItemPos pos = { 0, 0, 0 };
+		if (item) {
+			auto it = item_pos.find(item);
+			if (it == item_pos.end()) {
+				return false;
+			}
+			pos = it->second;
+		}
+		annot.push_back((uint32_t) ident.declkind);
+		annot.push_back(pos.cls);
+		annot.push_back(pos.member);
+		annot.push_back(pos.var);
+		annot.push_back((uint32_t) ident.slot_off);
+		annot.push_back((uint32_t) ident.slot_size);
+	}
+
+	std::vector<char> strs;
+	for (size_t i = 0; i < out.symbols.size(); i++) {
+		const std::string &s = i ? out.symbols[i].GetString() : std::string();
+		uint32_t len = (uint32_t) s.size();
+		strs.insert(strs.end(), (const char *) &len, (const char *) &len + sizeof(len));
+		strs.insert(strs.end(), s.begin(), s.end());
+		strs.resize((strs.size() + 3) & ~3);
+	}
+
+	size_t n = out.size();
+	Header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, ASTCACHE_MAGIC, sizeof(ASTCACHE_MAGIC));
+	h.version = VERSION;
+	h.node_count = (uint32_t) n;
+	h.src_hash = hash;
+	h.src_size = srclen;
+	h.symbol_count = (uint32_t) out.symbols.size();
+	h.clsinfo_size = (uint32_t) cls.size();
+	h.annot_size = (uint32_t) annot.size();
+
+	std::vector<char> image(sizeof(Header));
+	h.off_kind = AppendSection(image, out.kind, n * sizeof(ASTNodeKind));
+	h.off_loc = AppendSection(image, out.loc, n * sizeof(yyltype));
+	h.off_first = AppendSection(image, out.first, (n + 1) * sizeof(FlatAST::NodeId));
+	h.off_data = AppendSection(image, out.data, n * sizeof(uint32_t));
+	h.off_symbol = AppendSection(image, strs.data(), strs.size());
+	h.off_clsinfo = AppendSection(image, cls.data(), cls.size() * sizeof(uint32_t));
+	h.off_annot = AppendSection(image, annot.data(), annot.size() * sizeof(uint32_t));
+	h.file_size = image.size();
+	h.data_hash = HashSource(image.data() + sizeof(Header), image.size() - sizeof(Header));
+	memcpy(image.data(), &h, sizeof(h));
+
+	// write a private temporary file and rename it into place,
+	// so a concurrent Load() or Save() of the same source never sees a partial image
+	std::string path = GetPath(hash);
+	char tmpname[32];
+	sprintf(tmpname, ".%u.tmp", (unsigned) GetCurrentThreadId());
+	std::string tmppath = path + tmpname;
+	FILE *fp = fopen(tmppath.c_str(), "wb");
+	if (!fp) {
+		return false;
+	}
+	bool ok = fwrite(image.data(), 1, image.size(), fp) == image.size();
+	ok = fclose(fp) == 0 && ok;
+	ok = ok && MoveFileExA(tmppath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+	if (!ok) {
+		remove(tmppath.c_str());
+	}
+	return ok;
+}
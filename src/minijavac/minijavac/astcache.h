@@ -0,0 +1,65 @@
+#pragma once
+
+//////////////// ASTCache ////////////////
+
+// binary image of a parsed program, keyed by a hash of the source text:
+//   Header | FlatAST columns | symbol names | ClassInfoList | type annotations
+// the file is mapped read-only and the ASTNode tree is inflated straight from the mapped columns,
+// the nodes get back the types and bindings TypeCheck stored on them, so a hit needs no type check,
+// any image that fails its checksum or bounds checks is treated as a miss,
+// Load() and Save() keep no state in the cache object and may run on several threads at once
+class ASTCache {
+	static const uint32_t VERSION = 3;
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t node_count;
+		uint64_t src_hash;
+		uint64_t src_size;
+		uint64_t file_size;
+		uint64_t data_hash; // of everything after the header
+		uint32_t symbol_count;
+		uint32_t clsinfo_size; // in uint32_t
+		uint32_t annot_size; // in uint32_t
+		uint64_t off_kind;
+		uint64_t off_loc;
+		uint64_t off_first;
+		uint64_t off_data;
+		uint64_t off_symbol;
+		uint64_t off_clsinfo;
+		uint64_t off_annot;
+	};
+
+	// read-only view of one image file, unmapped on destruction
+	class MappedImage {
+		HANDLE file;
+		HANDLE mapping;
+	public:
+		const char *view;
+		size_t size;
+	public:
+		MappedImage();
+		~MappedImage();
+		MappedImage(const MappedImage &) = delete;
+		MappedImage &operator = (const MappedImage &) = delete;
+		bool Map(const std::string &path);
+		void Unmap();
+	};
+
+	class SectionReader;
+
+	std::string dir;
+private:
+	ASTCache();
+public:
+	static ASTCache *Instance();
+	static uint64_t HashSource(const char *src, size_t len);
+	void SetDirectory(const char *dir);
+	bool Enabled();
+	std::string GetPath(uint64_t hash);
+
+	// on success goal and clsinfo describe the cached, type checked program, its nodes are allocated from the current ASTNodePool
+	bool Load(uint64_t hash, size_t srclen, ASTGoal *&goal, ClassInfoList &clsinfo);
+	bool Save(uint64_t hash, size_t srclen, ASTGoal *goal, size_t nodecount, ClassInfoList &clsinfo); // after TypeCheck
+};
@@ -3,50 +3,175 @@
 
 //////////////// ASTNodePool ////////////////
 
-ASTNodePool::ASTNodePool()
+thread_local ASTNodePool *ASTNodePool::current = nullptr;
+
+ASTNodePool::Scope::Scope(ASTNodePool *pool) : prev(current)
+{
+	current = pool;
+}
+ASTNodePool::Scope::~Scope()
+{
+	current = prev;
+}
+
+ASTNodePool::ASTNodePool() : cur(nullptr), end(nullptr), used(0), reserved(0)
+{
+}
+ASTNodePool::~ASTNodePool()
 {
+	Release();
 }
-ASTNodePool *ASTNodePool::Instance()
+ASTNodePool *ASTNodePool::Current()
 {
-	static ASTNodePool inst;
-	return &inst;
+	assert(current);
+	return current;
 }
-std::list<std::shared_ptr<ASTNode> >::iterator ASTNodePool::RegisterNode(ASTNode *ptr)
+void *ASTNodePool::Allocate(size_t size)
 {
-	pool.push_front(std::shared_ptr<ASTNode>(ptr));
-	return pool.begin();
+	size = (size + ALIGN - 1) & ~(ALIGN - 1);
+	used += size;
+	if (size > BLOCK_SIZE / 4) {
+		// large child vectors get a block of their own, the current block stays open
+		char *blk = (char *) malloc(size);
+		if (!blk) panic();
+		large.push_back(blk);
+		reserved += size;
+		return blk;
+	}
+	if (size > (size_t)(end - cur)) {
+		char *blk;
+		if (!spare.empty()) {
+			blk = spare.back();
+			spare.pop_back();
+		} else {
+			blk = (char *) malloc(BLOCK_SIZE);
+			if (!blk) panic();
+			reserved += BLOCK_SIZE;
+		}
+		blocks.push_back(blk);
+		cur = blk;
+		end = blk + BLOCK_SIZE;
+	}
+	void *ptr = cur;
+	cur += size;
+	return ptr;
 }
-std::shared_ptr<ASTNode> ASTNodePool::GetSharedPtr(std::list<std::shared_ptr<ASTNode> >::iterator handle)
+void ASTNodePool::RegisterNode(ASTNode *ptr)
 {
-	return *handle;
+	nodes.push_back(ptr);
 }
-void ASTNodePool::Shrink()
+size_t ASTNodePool::Shrink(ASTNode *root)
 {
-	bool flag;
-	do {
-		flag = false;
-		for (auto it = pool.begin(); it != pool.end(); ) {
-			if (it->use_count() == 1) {
-				//printf("ASTNodePool::Shrink() delete %p\n", it->get());
-				pool.erase(it++);
-				flag = true;
-			} else {
-				it++;
+	// mark everything reachable from root, then unlink the rest in one sweep,
+	// their storage stays in the arena until Release()
+	std::vector<ASTNode *> stack;
+	if (root) {
+		root->marked = true;
+		stack.push_back(root);
+	}
+	while (!stack.empty()) {
+		ASTNode *node = stack.back();
+		stack.pop_back();
+		for (auto ch: node->ch) {
+			if (!ch->marked) {
+				ch->marked = true;
+				stack.push_back(ch);
 			}
 		}
-	} while (flag);
+	}
+
+	size_t n = 0;
+	for (auto node: nodes) {
+		if (node->marked) {
+			node->marked = false;
+			nodes[n++] = node;
+		}
+	}
+	size_t dropped = nodes.size() - n;
+	nodes.resize(n);
+	return dropped;
+}
+void ASTNodePool::Reset()
+{
+	// nodes own nothing outside the arena, so no destructor has to run
+	for (auto blk: large) {
+		free(blk);
+	}
+	large.clear();
+	spare.insert(spare.end(), blocks.begin(), blocks.end());
+	blocks.clear();
+	nodes.clear();
+	cur = end = nullptr;
+	used = 0;
+	reserved = spare.size() * BLOCK_SIZE;
+}
+void ASTNodePool::Release()
+{
+	Reset();
+	for (auto blk: spare) {
+		free(blk);
+	}
+	spare.clear();
+	reserved = 0;
+}
+size_t ASTNodePool::GetNodeCount()
+{
+	return nodes.size();
+}
+size_t ASTNodePool::GetUsedSize()
+{
+	return used;
 }
+size_t ASTNodePool::GetReservedSize()
+{
+	return reserved;
+}
+
+
 
 
 
 
 
+//////////////// ASTNodeKind ////////////////
+
+static const char *const kind_names[AST_NODE_KIND_COUNT] = {
+	"class ASTNode",
+#define MAKE_NAME(cls, super) "class " #cls,
+	AST_NODE_KIND_LIST(MAKE_NAME)
+#undef MAKE_NAME
+};
+static const size_t kind_name_lengths[AST_NODE_KIND_COUNT] = {
+	sizeof("class ASTNode") - 1,
+#define MAKE_LENGTH(cls, super) sizeof("class " #cls) - 1,
+	AST_NODE_KIND_LIST(MAKE_LENGTH)
+#undef MAKE_LENGTH
+};
+
+const char *GetKindName(ASTNodeKind kind)
+{
+	return kind_names[(size_t) kind];
+}
+size_t GetKindNameLength(ASTNodeKind kind)
+{
+	return kind_name_lengths[(size_t) kind];
+}
+
 
 //////////////// ASTNode ////////////////
 
-ASTNode::ASTNode()
+void *ASTNode::operator new(size_t size)
 {
-	pool_handle = ASTNodePool::Instance()->RegisterNode(this);
+	return ASTNodePool::Current()->Allocate(size);
+}
+void ASTNode::operator delete(void *ptr)
+{
+	// storage belongs to ASTNodePool
+}
+
+ASTNode::ASTNode() : marked(false), kind(ASTNodeKind::ASTNode)
+{
+	ASTNodePool::Current()->RegisterNode(this);
 	memset(&loc, 0, sizeof(loc));
 }
 ASTNode::ASTNode(const yyltype &loc) : ASTNode()
@@ -55,6 +180,7 @@ ASTNode::ASTNode(const yyltype &loc) : ASTNode()
 }
 ASTNode::ASTNode(const yyltype &loc, std::initializer_list<ASTNode *> l) : ASTNode(loc)
 {
+	ch.reserve(l.size());
 	for (auto ptr: l) {
 		AddChild(ptr);
 	}
@@ -64,15 +190,15 @@ ASTNode::~ASTNode()
 {
 }
 
-void ASTNode::Dump()
+void ASTNode::Dump(CompilationContext &ctx)
 {
 	printf("Dump %p: %s\n", this, typeid(*this).name());
-	MiniJavaC::Instance()->DumpContent(loc);
+	ctx.DumpContent(loc, stdout);
 }
 
-void ASTNode::DumpTree()
+void ASTNode::DumpTree(CompilationContext &ctx)
 {
-	PrintVisitor v;
+	PrintVisitor v(ctx);
 	printf("DumpTree %p: %s\n", this, typeid(*this).name());
 	v.DumpTree(this, true);
 }
@@ -82,50 +208,57 @@ void ASTNode::Accept(ASTNodeVisitor &visitor)
 	Accept(visitor, 0);
 }
 
-std::shared_ptr<ASTNode> ASTNode::GetSharedPtr()
-{
-	return ASTNodePool::Instance()->GetSharedPtr(pool_handle);
-}
-
-void ASTNode::AddChild(std::shared_ptr<ASTNode> ch_ptr)
+void ASTNode::AddChild(ASTNode *ch_ptr)
 {
 	ch.push_back(ch_ptr);
 }
 
-void ASTNode::AddChild(ASTNode *ch_ptr)
+// list nodes keep all elements as direct children,
+// the grammar appends to the existing node instead of wrapping it
+ASTNode *ASTNode::Append(const yyltype &loc, ASTNode *ch_ptr)
 {
-	AddChild(ch_ptr->GetSharedPtr());
+	this->loc = loc;
+	AddChild(ch_ptr);
+	return this;
 }
 
 
-std::shared_ptr<ASTStatement> ASTMainClass::GetASTStatement()
+ASTIdentifier &ASTMainClass::GetASTIdentifier()
 {
-	return std::dynamic_pointer_cast<ASTStatement>(ch[2]);
+	return Child<ASTIdentifier>(0);
 }
-std::shared_ptr<ASTMainClass> ASTGoal::GetASTMainClass()
+ASTStatement &ASTMainClass::GetASTStatement()
 {
-	return std::dynamic_pointer_cast<ASTMainClass>(ch[0]);
+	return Child<ASTStatement>(2);
 }
-ClassInfoList ASTGoal::GetClassInfoList()
+ASTMainClass &ASTGoal::GetASTMainClass()
 {
-	ClassInfoVisitor v;
-	ASTNode::Accept(v);
+	return Child<ASTMainClass>(0);
+}
+ClassInfoList ASTGoal::GetClassInfoList(CompilationContext &ctx)
+{
+	ClassInfoVisitor v(ctx);
+	v.Dispatch(this);
 	return std::move(v.list);
 }
 
 //////////////// ASTNode derived classes ////////////////
 
-ASTIdentifier::ASTIdentifier(const yyltype &loc, const std::string &id) : ASTExpression(loc), id(id)
+ASTIdentifier::ASTIdentifier(const yyltype &loc, Symbol id) : ASTExpression(loc), id(id)
 {
+	kind = ASTNodeKind::ASTIdentifier;
 }
 ASTNumber::ASTNumber(const yyltype &loc, int val) : ASTExpression(loc), val(val)
 {
+	kind = ASTNodeKind::ASTNumber;
 }
 ASTBoolean::ASTBoolean(const yyltype &loc, int val) : ASTExpression(loc), val(val)
 {
+	kind = ASTNodeKind::ASTBoolean;
 }
 ASTBinaryExpression::ASTBinaryExpression(const yyltype &loc, std::initializer_list<ASTNode *> l, int op) : ASTExpression(loc, l), op(op)
 {
+	kind = ASTNodeKind::ASTBinaryExpression;
 }
 const char *ASTBinaryExpression::GetOperatorName()
 {
@@ -141,6 +274,7 @@ const char *ASTBinaryExpression::GetOperatorName()
 }
 ASTUnaryExpression::ASTUnaryExpression(const yyltype &loc, std::initializer_list<ASTNode *> l, int op) : ASTExpression(loc, l), op(op)
 {
+	kind = ASTNodeKind::ASTUnaryExpression;
 }
 const char *ASTUnaryExpression::GetOperatorName()
 {
@@ -157,86 +291,111 @@ const char *ASTUnaryExpression::GetOperatorName()
 
 
 ////// Expression
-std::shared_ptr<ASTExpression> ASTBinaryExpression::GetLeftASTExpression()
+TypeInfo ASTExpression::GetTypeInfo()
+{
+	return TypeInfo { (ASTType::VarType) restype, resclsname };
+}
+void ASTExpression::SetTypeInfo(const TypeInfo &tinfo)
+{
+	restype = (uint8_t) tinfo.type;
+	resclsname = tinfo.clsname;
+}
+ASTExpression &ASTBinaryExpression::GetLeftASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[0]);
+	return Child<ASTExpression>(0);
 }
-std::shared_ptr<ASTExpression> ASTBinaryExpression::GetRightASTExpression()
+ASTExpression &ASTBinaryExpression::GetRightASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[1]);
+	return Child<ASTExpression>(1);
 }
-std::shared_ptr<ASTExpression> ASTPrintlnStatement::GetASTExpression()
+ASTExpression &ASTPrintlnStatement::GetASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[0]);
+	return Child<ASTExpression>(0);
 }
-std::shared_ptr<ASTExpression> ASTUnaryExpression::GetASTExpression()
+ASTExpression &ASTUnaryExpression::GetASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[0]);
+	return Child<ASTExpression>(0);
 }
-std::shared_ptr<ASTExpression> ASTArrayLengthExpression::GetASTExpression()
+ASTExpression &ASTArrayLengthExpression::GetASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[0]);
+	return Child<ASTExpression>(0);
 }
-std::shared_ptr<ASTExpression> ASTNewIntArrayExpression::GetASTExpression()
+ASTExpression &ASTNewIntArrayExpression::GetASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[0]);
+	return Child<ASTExpression>(0);
 }
 
 
-std::shared_ptr<ASTExpression> ASTFunctionCallExpression::GetASTExpression()
+ASTExpression &ASTFunctionCallExpression::GetASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[0]);
+	return Child<ASTExpression>(0);
 }
-std::shared_ptr<ASTIdentifier> ASTFunctionCallExpression::GetASTIdentifier()
+ASTIdentifier &ASTFunctionCallExpression::GetASTIdentifier()
 {
-	return std::dynamic_pointer_cast<ASTIdentifier>(ch[1]);
+	return Child<ASTIdentifier>(1);
 }
-std::shared_ptr<ASTArgExpressionList1> ASTFunctionCallExpression::GetASTArgExpressionList1()
+ASTArgExpressionList1 &ASTFunctionCallExpression::GetASTArgExpressionList1()
 {
-	return std::dynamic_pointer_cast<ASTArgExpressionList1>(ch[2]);
+	return Child<ASTArgExpressionList1>(2);
+}
+std::vector<ASTExpression *> ASTFunctionCallExpression::GetArgs()
+{
+	class MethodArgVisitor : public ASTStaticVisitor<MethodArgVisitor> {
+	public:
+		using ASTStaticVisitor<MethodArgVisitor>::Visit;
+		std::vector<ASTExpression *> arglist;
+		void Visit(ASTExpression *node, int level)
+		{
+			arglist.push_back(node);
+		}
+	};
+
+	MethodArgVisitor v;
+	v.Dispatch(&GetASTArgExpressionList1());
+	return v.arglist;
 }
 
 
 ////// Statement
-std::shared_ptr<ASTIdentifier> ASTArrayAssignStatement::GetASTIdentifier()
+ASTIdentifier &ASTArrayAssignStatement::GetASTIdentifier()
 {
-	return std::dynamic_pointer_cast<ASTIdentifier>(ch[0]);
+	return Child<ASTIdentifier>(0);
 }
-std::shared_ptr<ASTExpression> ASTArrayAssignStatement::GetSubscriptASTExpression()
+ASTExpression &ASTArrayAssignStatement::GetSubscriptASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[1]);
+	return Child<ASTExpression>(1);
 }
-std::shared_ptr<ASTExpression> ASTArrayAssignStatement::GetASTExpression()
+ASTExpression &ASTArrayAssignStatement::GetASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[2]);
+	return Child<ASTExpression>(2);
 }
-std::shared_ptr<ASTIdentifier> ASTAssignStatement::GetASTIdentifier()
+ASTIdentifier &ASTAssignStatement::GetASTIdentifier()
 {
-	return std::dynamic_pointer_cast<ASTIdentifier>(ch[0]);
+	return Child<ASTIdentifier>(0);
 }
-std::shared_ptr<ASTExpression> ASTAssignStatement::GetASTExpression()
+ASTExpression &ASTAssignStatement::GetASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[1]);
+	return Child<ASTExpression>(1);
 }
-std::shared_ptr<ASTExpression> ASTWhileStatement::GetASTExpression()
+ASTExpression &ASTWhileStatement::GetASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[0]);
+	return Child<ASTExpression>(0);
 }
-std::shared_ptr<ASTStatement> ASTWhileStatement::GetASTStatement()
+ASTStatement &ASTWhileStatement::GetASTStatement()
 {
-	return std::dynamic_pointer_cast<ASTStatement>(ch[1]);
+	return Child<ASTStatement>(1);
 }
-std::shared_ptr<ASTExpression> ASTIfElseStatement::GetASTExpression()
+ASTExpression &ASTIfElseStatement::GetASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[0]);
+	return Child<ASTExpression>(0);
 }
-std::shared_ptr<ASTStatement> ASTIfElseStatement::GetThenASTStatement()
+ASTStatement &ASTIfElseStatement::GetThenASTStatement()
 {
-	return std::dynamic_pointer_cast<ASTStatement>(ch[1]);
+	return Child<ASTStatement>(1);
 }
-std::shared_ptr<ASTStatement> ASTIfElseStatement::GetElseASTStatement()
+ASTStatement &ASTIfElseStatement::GetElseASTStatement()
 {
-	return std::dynamic_pointer_cast<ASTStatement>(ch[2]);
+	return Child<ASTStatement>(2);
 }
 
 
@@ -245,6 +404,7 @@ std::shared_ptr<ASTStatement> ASTIfElseStatement::GetElseASTStatement()
 
 ASTType::ASTType(const yyltype &loc, std::initializer_list<ASTNode *> l, VarType type) : ASTNode(loc, l), type(type)
 {
+	kind = ASTNodeKind::ASTType;
 }
 const char *ASTType::GetTypeName()
 {
@@ -260,16 +420,16 @@ const char *ASTType::GetTypeName(ASTType::VarType type)
 		default:           return "UNKNOWN";
 	}
 }
-std::shared_ptr<ASTIdentifier> ASTType::GetASTIdentifier()
+ASTIdentifier &ASTType::GetASTIdentifier()
 {
-	return std::dynamic_pointer_cast<ASTIdentifier>(ch[0]);
+	return Child<ASTIdentifier>(0);
 }
 TypeInfo ASTType::GetTypeInfo()
 {
 	if (type != VT_CLASS) {
 		return TypeInfo { type };
 	} else {
-		return TypeInfo { type, GetASTIdentifier()->id };
+		return TypeInfo { type, GetASTIdentifier().id };
 	}
 }
 data_off_t ASTType::GetTypeSize()
@@ -284,93 +444,93 @@ data_off_t ASTType::GetTypeSize()
 }
 
 
-std::shared_ptr<ASTIdentifier> ASTClassDeclaration::GetASTIdentifier()
+ASTIdentifier &ASTClassDeclaration::GetASTIdentifier()
 {
-	return std::dynamic_pointer_cast<ASTIdentifier>(ch[0]);
+	return Child<ASTIdentifier>(0);
 }
-std::shared_ptr<ASTVarDeclarationList> ASTClassDeclaration::GetASTVarDeclarationList()
+ASTVarDeclarationList &ASTClassDeclaration::GetASTVarDeclarationList()
 {
-	return std::dynamic_pointer_cast<ASTVarDeclarationList>(ch[1]);
+	return Child<ASTVarDeclarationList>(1);
 }
-std::shared_ptr<ASTMethodDeclarationList> ASTClassDeclaration::GetASTMethodDeclarationList()
+ASTMethodDeclarationList &ASTClassDeclaration::GetASTMethodDeclarationList()
 {
-	return std::dynamic_pointer_cast<ASTMethodDeclarationList>(ch[2]);
+	return Child<ASTMethodDeclarationList>(2);
 }
 
-std::shared_ptr<ASTIdentifier> ASTDerivedClassDeclaration::GetASTIdentifier()
+ASTIdentifier &ASTDerivedClassDeclaration::GetASTIdentifier()
 {
-	return std::dynamic_pointer_cast<ASTIdentifier>(ch[0]);
+	return Child<ASTIdentifier>(0);
 }
-std::shared_ptr<ASTIdentifier> ASTDerivedClassDeclaration::GetBaseASTIdentifier()
+ASTIdentifier &ASTDerivedClassDeclaration::GetBaseASTIdentifier()
 {
-	return std::dynamic_pointer_cast<ASTIdentifier>(ch[1]);
+	return Child<ASTIdentifier>(1);
 }
-std::shared_ptr<ASTVarDeclarationList> ASTDerivedClassDeclaration::GetASTVarDeclarationList()
+ASTVarDeclarationList &ASTDerivedClassDeclaration::GetASTVarDeclarationList()
 {
-	return std::dynamic_pointer_cast<ASTVarDeclarationList>(ch[2]);
+	return Child<ASTVarDeclarationList>(2);
 }
-std::shared_ptr<ASTMethodDeclarationList> ASTDerivedClassDeclaration::GetASTMethodDeclarationList()
+ASTMethodDeclarationList &ASTDerivedClassDeclaration::GetASTMethodDeclarationList()
 {
-	return std::dynamic_pointer_cast<ASTMethodDeclarationList>(ch[3]);
+	return Child<ASTMethodDeclarationList>(3);
 }
 
 
-std::shared_ptr<ASTType> ASTVarDeclaration::GetASTType()
+ASTType &ASTVarDeclaration::GetASTType()
 {
-	return std::dynamic_pointer_cast<ASTType>(ch[0]);
+	return Child<ASTType>(0);
 }
-std::shared_ptr<ASTIdentifier> ASTVarDeclaration::GetASTIdentifier()
+ASTIdentifier &ASTVarDeclaration::GetASTIdentifier()
 {
-	return std::dynamic_pointer_cast<ASTIdentifier>(ch[1]);
+	return Child<ASTIdentifier>(1);
 }
 
-std::shared_ptr<ASTType> ASTMethodDeclaration::GetASTType()
+ASTType &ASTMethodDeclaration::GetASTType()
 {
-	return std::dynamic_pointer_cast<ASTType>(ch[0]);
+	return Child<ASTType>(0);
 }
-std::shared_ptr<ASTIdentifier> ASTMethodDeclaration::GetASTIdentifier()
+ASTIdentifier &ASTMethodDeclaration::GetASTIdentifier()
 {
-	return std::dynamic_pointer_cast<ASTIdentifier>(ch[1]);
+	return Child<ASTIdentifier>(1);
 }
-std::shared_ptr<ASTArgDeclarationList1> ASTMethodDeclaration::GetASTArgDeclarationList1()
+ASTArgDeclarationList1 &ASTMethodDeclaration::GetASTArgDeclarationList1()
 {
-	return std::dynamic_pointer_cast<ASTArgDeclarationList1>(ch[2]);
+	return Child<ASTArgDeclarationList1>(2);
 }
-std::shared_ptr<ASTVarDeclarationList> ASTMethodDeclaration::GetASTVarDeclarationList()
+ASTVarDeclarationList &ASTMethodDeclaration::GetASTVarDeclarationList()
 {
-	return std::dynamic_pointer_cast<ASTVarDeclarationList>(ch[3]);
+	return Child<ASTVarDeclarationList>(3);
 }
-std::shared_ptr<ASTStatementList> ASTMethodDeclaration::GetASTStatementList()
+ASTStatementList &ASTMethodDeclaration::GetASTStatementList()
 {
-	return std::dynamic_pointer_cast<ASTStatementList>(ch[4]);
+	return Child<ASTStatementList>(4);
 }
-std::shared_ptr<ASTExpression> ASTMethodDeclaration::GetASTExpression()
+ASTExpression &ASTMethodDeclaration::GetASTExpression()
 {
-	return std::dynamic_pointer_cast<ASTExpression>(ch[5]);
+	return Child<ASTExpression>(5);
 }
-std::shared_ptr<ASTIdentifier> ASTNewExpression::GetASTIdentifier()
+ASTIdentifier &ASTNewExpression::GetASTIdentifier()
 {
-	return std::dynamic_pointer_cast<ASTIdentifier>(ch[0]);
+	return Child<ASTIdentifier>(0);
 }
 
 
-MethodDeclList ASTMethodDeclarationList::GetMethodDeclList(MethodDeclList base, const std::string &clsname)
+MethodDeclList ASTMethodDeclarationList::GetMethodDeclList(CompilationContext &ctx, MethodDeclList base, Symbol clsname)
 {
-	MethodDeclListVisitor v(base, clsname);
-	ASTNode::Accept(v);
+	MethodDeclListVisitor v(ctx, base, clsname);
+	v.Dispatch(this);
 	return std::move(v.list);
 }
 
-VarDeclList ASTArgDeclarationList1::GetVarDeclList(VarDeclList base)
+VarDeclList ASTArgDeclarationList1::GetVarDeclList(CompilationContext &ctx, VarDeclList base)
 {
-	VarDeclListVisitor v(base);
-	ASTNode::Accept(v);
+	VarDeclListVisitor v(ctx, base);
+	v.Dispatch(this);
 	return std::move(v.list);
 }
-VarDeclList ASTVarDeclarationList::GetVarDeclList(VarDeclList base)
+VarDeclList ASTVarDeclarationList::GetVarDeclList(CompilationContext &ctx, VarDeclList base)
 {
-	VarDeclListVisitor v(base);
-	ASTNode::Accept(v);
+	VarDeclListVisitor v(ctx, base);
+	v.Dispatch(this);
 	return std::move(v.list);
 }
 
@@ -4,18 +4,126 @@
 
 class ASTNode;
 
+// bump-pointer arena owning all nodes of one compilation,
+// nodes and their child vectors are never freed one by one
 class ASTNodePool {
 	friend ASTNode;
-	
-	std::list<std::shared_ptr<ASTNode> > pool;
+
+	static thread_local ASTNodePool *current;
+
+	static const size_t BLOCK_SIZE = 64 * 1024;
+	static const size_t ALIGN = alignof(std::max_align_t);
+
+	std::vector<char *> blocks; // BLOCK_SIZE each, the last one is being filled
+	std::vector<char *> large; // oversized allocations, one block each
+	std::vector<char *> spare; // BLOCK_SIZE blocks kept by Reset() for reuse
+	char *cur;
+	char *end;
+	size_t used;
+	size_t reserved;
+	std::vector<ASTNode *> nodes;
 private:
+	void RegisterNode(ASTNode *ptr);
+public:
+	// while a Scope is alive, nodes created on this thread are allocated from its pool
+	class Scope {
+		ASTNodePool *prev;
+	public:
+		Scope(ASTNodePool *pool);
+		~Scope();
+	};
+
 	ASTNodePool();
-	std::list<std::shared_ptr<ASTNode> >::iterator RegisterNode(ASTNode *ptr);
-	std::shared_ptr<ASTNode> GetSharedPtr(std::list<std::shared_ptr<ASTNode> >::iterator handle);
-public:
-	static ASTNodePool *Instance();
-	void Shrink();
-};
+	~ASTNodePool();
+	ASTNodePool(const ASTNodePool &) = delete;
+	ASTNodePool &operator = (const ASTNodePool &) = delete;
+	static ASTNodePool *Current();
+	void *Allocate(size_t size);
+	size_t Shrink(ASTNode *root); // unregisters nodes unreachable from root, their memory is only reused after Reset()
+	void Reset(); // drop all nodes but keep the blocks, so the next compilation starts warm
+	void Release();
+	size_t GetNodeCount();
+	size_t GetUsedSize();
+	size_t GetReservedSize();
+};
+
+template <class T>
+class ASTNodeAllocator {
+public:
+	typedef T value_type;
+	ASTNodeAllocator() {}
+	template <class U> ASTNodeAllocator(const ASTNodeAllocator<U> &) {}
+	T *allocate(size_t n) { return static_cast<T *>(ASTNodePool::Current()->Allocate(n * sizeof(T))); }
+	void deallocate(T *ptr, size_t n) {}
+	template <class U> bool operator == (const ASTNodeAllocator<U> &) const { return true; }
+	template <class U> bool operator != (const ASTNodeAllocator<U> &) const { return false; }
+};
+
+
+//////////////// ASTNodeKind ////////////////
+
+// every node class below ASTNode with its direct base,
+// a derived class is listed right after its base so each class covers a contiguous range of kinds
+#define AST_NODE_KIND_LIST(X) \
+	X(ASTExpression, ASTNode) \
+	X(ASTIdentifier, ASTExpression) \
+	X(ASTNumber, ASTExpression) \
+	X(ASTBoolean, ASTExpression) \
+	X(ASTBinaryExpression, ASTExpression) \
+	X(ASTUnaryExpression, ASTExpression) \
+	X(ASTArrayLengthExpression, ASTExpression) \
+	X(ASTFunctionCallExpression, ASTExpression) \
+	X(ASTThisExpression, ASTExpression) \
+	X(ASTNewIntArrayExpression, ASTExpression) \
+	X(ASTNewExpression, ASTExpression) \
+	X(ASTArgExpressionList1, ASTNode) \
+	X(ASTArgExpressionList2, ASTNode) \
+	X(ASTStatement, ASTNode) \
+	X(ASTArrayAssignStatement, ASTStatement) \
+	X(ASTAssignStatement, ASTStatement) \
+	X(ASTPrintlnStatement, ASTStatement) \
+	X(ASTWhileStatement, ASTStatement) \
+	X(ASTIfElseStatement, ASTStatement) \
+	X(ASTBlockStatement, ASTStatement) \
+	X(ASTStatementList, ASTNode) \
+	X(ASTType, ASTNode) \
+	X(ASTArgDeclarationList1, ASTNode) \
+	X(ASTArgDeclarationList2, ASTNode) \
+	X(ASTMethodDeclaration, ASTNode) \
+	X(ASTMethodDeclarationList, ASTNode) \
+	X(ASTVarDeclaration, ASTNode) \
+	X(ASTVarDeclarationList, ASTNode) \
+	X(ASTClassDeclaration, ASTNode) \
+	X(ASTDerivedClassDeclaration, ASTNode) \
+	X(ASTClassDeclarationList, ASTNode) \
+	X(ASTMainClass, ASTNode) \
+	X(ASTGoal, ASTNode)
+
+enum class ASTNodeKind : uint8_t {
+	ASTNode,
+#define MAKE_KIND(cls, super) cls,
+	AST_NODE_KIND_LIST(MAKE_KIND)
+#undef MAKE_KIND
+};
+
+static const size_t AST_NODE_KIND_COUNT = (size_t) ASTNodeKind::ASTGoal + 1;
+
+// "class ASTIdentifier", spelled the way MSVC's typeid(*node).name() does,
+// interned so exporters don't ask RTTI for every node
+const char *GetKindName(ASTNodeKind kind);
+size_t GetKindNameLength(ASTNodeKind kind);
+
+// range of kinds a node class and its derived classes use
+#define DECLARE_AST_KIND(first, last) \
+public: \
+	static constexpr ASTNodeKind KIND_FIRST = ASTNodeKind::first; \
+	static constexpr ASTNodeKind KIND_LAST = ASTNodeKind::last;
+
+// constructors of node classes without own data
+#define DECLARE_AST_CTOR(cls, super) \
+public: \
+	cls(const yyltype &loc) : super(loc) { kind = ASTNodeKind::cls; } \
+	cls(const yyltype &loc, std::initializer_list<ASTNode *> l) : super(loc, l) { kind = ASTNodeKind::cls; }
 
 
 //////////////// ASTNode ////////////////
@@ -23,24 +131,43 @@ public:
 class ASTNodeVisitor;
 
 class ASTNode {
-	std::list<std::shared_ptr<ASTNode> >::iterator pool_handle;
+	friend ASTNodePool;
+	DECLARE_AST_KIND(ASTNode, ASTGoal)
+private:
+	bool marked; // reachable from the root, see ASTNodePool::Shrink()
 public:
-	std::vector<std::shared_ptr<ASTNode> > ch;
+	ASTNodeKind kind;
+	std::vector<ASTNode *, ASTNodeAllocator<ASTNode *> > ch;
 	yyltype loc;
 private:
 	
 public:
+	static void *operator new(size_t size);
+	static void operator delete(void *ptr);
 	ASTNode();
 	ASTNode(const yyltype &loc);
 	ASTNode(const yyltype &loc, std::initializer_list<ASTNode *> l);
 	virtual ~ASTNode();
-	void Dump();
-	void DumpTree();
+	void Dump(CompilationContext &ctx);
+	void DumpTree(CompilationContext &ctx);
 	virtual void Accept(ASTNodeVisitor &visitor, int level);
 	void Accept(ASTNodeVisitor &visitor);
-	std::shared_ptr<ASTNode> GetSharedPtr();
-	void AddChild(std::shared_ptr<ASTNode> ch_ptr);
 	void AddChild(ASTNode *ch_ptr);
+	ASTNode *Append(const yyltype &loc, ASTNode *ch_ptr);
+
+	template <class T> bool Is() const
+	{
+		return T::KIND_FIRST <= kind && kind <= T::KIND_LAST;
+	}
+	template <class T> T &As()
+	{
+		assert(Is<T>());
+		return *static_cast<T *>(this);
+	}
+	template <class T> T &Child(size_t i)
+	{
+		return ch[i]->As<T>();
+	}
 };
 
 
@@ -49,22 +176,54 @@ public:
 
 // ASTExpresstion
 
+class TypeInfo;
+
 class ASTExpression : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTExpression, ASTNewExpression)
+	DECLARE_AST_CTOR(ASTExpression, ASTNode)
+public:
+	// the type TypeCheck resolved, VT_UNKNOWN until then or if it failed
+	uint8_t restype = 0; // ASTType::VarType
+	Symbol resclsname;
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
+	TypeInfo GetTypeInfo();
+	void SetTypeInfo(const TypeInfo &tinfo);
 };
 
 
+class VarDeclItem;
+class MethodDeclItem;
+class ClassInfoItem;
 class ASTIdentifier : public ASTExpression {
-public:
-	std::string id;
+	DECLARE_AST_KIND(ASTIdentifier, ASTIdentifier)
+public:
+	// what the name refers to, set by TypeCheck on the identifiers it resolves
+	enum DeclKind : uint8_t {
+		DECL_NONE,
+		DECL_LOCAL, // var, a local variable of the method
+		DECL_ARG, // var, an argument of the method
+		DECL_FIELD, // var, a member variable of this
+		DECL_METHOD, // method
+		DECL_CLASS, // cls
+	};
+	Symbol id;
+	DeclKind declkind = DECL_NONE;
+	union {
+		const VarDeclItem *var = nullptr;
+		const MethodDeclItem *method;
+		const ClassInfoItem *cls;
+	};
+	// the variable's slot, from EBP for DECL_LOCAL and DECL_ARG, from this for DECL_FIELD
+	data_off_t slot_off = 0;
+	data_off_t slot_size = 0;
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	ASTIdentifier(const yyltype &loc, const std::string &id);
+	ASTIdentifier(const yyltype &loc, Symbol id);
 };
 
 class ASTNumber : public ASTExpression {
+	DECLARE_AST_KIND(ASTNumber, ASTNumber)
 public:
 	int val;
 public:
@@ -73,6 +232,7 @@ public:
 };
 
 class ASTBoolean : public ASTExpression {
+	DECLARE_AST_KIND(ASTBoolean, ASTBoolean)
 public:
 	int val;
 private:
@@ -85,116 +245,134 @@ public:
 
 
 class ASTBinaryExpression : public ASTExpression {
+	DECLARE_AST_KIND(ASTBinaryExpression, ASTBinaryExpression)
 public:
 	int op;
 	ASTBinaryExpression(const yyltype &loc, std::initializer_list<ASTNode *> l, int op);
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
 	const char *GetOperatorName();
-	std::shared_ptr<ASTExpression> GetLeftASTExpression();
-	std::shared_ptr<ASTExpression> GetRightASTExpression();
+	ASTExpression &GetLeftASTExpression();
+	ASTExpression &GetRightASTExpression();
 };
 
 class ASTUnaryExpression : public ASTExpression {
+	DECLARE_AST_KIND(ASTUnaryExpression, ASTUnaryExpression)
 public:
 	int op;
 	ASTUnaryExpression(const yyltype &loc, std::initializer_list<ASTNode *> l, int op);
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
 	const char *GetOperatorName();
-	std::shared_ptr<ASTExpression> GetASTExpression();
+	ASTExpression &GetASTExpression();
 };
 
 class ASTArrayLengthExpression : public ASTExpression {
-	using ASTExpression::ASTExpression;
+	DECLARE_AST_KIND(ASTArrayLengthExpression, ASTArrayLengthExpression)
+	DECLARE_AST_CTOR(ASTArrayLengthExpression, ASTExpression)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTExpression> GetASTExpression();
+	ASTExpression &GetASTExpression();
 };
 class ASTArgExpressionList1;
 class ASTFunctionCallExpression : public ASTExpression {
-	using ASTExpression::ASTExpression;
+	DECLARE_AST_KIND(ASTFunctionCallExpression, ASTFunctionCallExpression)
+	DECLARE_AST_CTOR(ASTFunctionCallExpression, ASTExpression)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTExpression> GetASTExpression();
-	std::shared_ptr<ASTIdentifier> GetASTIdentifier();
-	std::shared_ptr<ASTArgExpressionList1> GetASTArgExpressionList1();
+	ASTExpression &GetASTExpression();
+	ASTIdentifier &GetASTIdentifier();
+	ASTArgExpressionList1 &GetASTArgExpressionList1();
+	std::vector<ASTExpression *> GetArgs(); // in source order
 };
 class ASTThisExpression : public ASTExpression {
-	using ASTExpression::ASTExpression;
+	DECLARE_AST_KIND(ASTThisExpression, ASTThisExpression)
+	DECLARE_AST_CTOR(ASTThisExpression, ASTExpression)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
 };
 class ASTNewIntArrayExpression : public ASTExpression {
-	using ASTExpression::ASTExpression;
+	DECLARE_AST_KIND(ASTNewIntArrayExpression, ASTNewIntArrayExpression)
+	DECLARE_AST_CTOR(ASTNewIntArrayExpression, ASTExpression)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTExpression> GetASTExpression();
+	ASTExpression &GetASTExpression();
 };
 class ASTNewExpression : public ASTExpression {
-	using ASTExpression::ASTExpression;
+	DECLARE_AST_KIND(ASTNewExpression, ASTNewExpression)
+	DECLARE_AST_CTOR(ASTNewExpression, ASTExpression)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTIdentifier> GetASTIdentifier();
+	ASTIdentifier &GetASTIdentifier();
 };
 
 class ASTArgExpressionList1 : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTArgExpressionList1, ASTArgExpressionList1)
+	DECLARE_AST_CTOR(ASTArgExpressionList1, ASTNode)
 };
 class ASTArgExpressionList2 : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTArgExpressionList2, ASTArgExpressionList2)
+	DECLARE_AST_CTOR(ASTArgExpressionList2, ASTNode)
 };
 
 
 // ASTStatment
 
 class ASTStatement : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTStatement, ASTBlockStatement)
+	DECLARE_AST_CTOR(ASTStatement, ASTNode)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
 };
 
 class ASTStatementList : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTStatementList, ASTStatementList)
+	DECLARE_AST_CTOR(ASTStatementList, ASTNode)
 };
 
 
 class ASTArrayAssignStatement : public ASTStatement {
-	using ASTStatement::ASTStatement;
+	DECLARE_AST_KIND(ASTArrayAssignStatement, ASTArrayAssignStatement)
+	DECLARE_AST_CTOR(ASTArrayAssignStatement, ASTStatement)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTIdentifier> GetASTIdentifier();
-	std::shared_ptr<ASTExpression> GetSubscriptASTExpression();
-	std::shared_ptr<ASTExpression> GetASTExpression();
+	ASTIdentifier &GetASTIdentifier();
+	ASTExpression &GetSubscriptASTExpression();
+	ASTExpression &GetASTExpression();
 };
 class ASTAssignStatement : public ASTStatement {
-	using ASTStatement::ASTStatement;
+	DECLARE_AST_KIND(ASTAssignStatement, ASTAssignStatement)
+	DECLARE_AST_CTOR(ASTAssignStatement, ASTStatement)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTIdentifier> GetASTIdentifier();
-	std::shared_ptr<ASTExpression> GetASTExpression();
+	ASTIdentifier &GetASTIdentifier();
+	ASTExpression &GetASTExpression();
 };
 class ASTPrintlnStatement : public ASTStatement {
-	using ASTStatement::ASTStatement;
+	DECLARE_AST_KIND(ASTPrintlnStatement, ASTPrintlnStatement)
+	DECLARE_AST_CTOR(ASTPrintlnStatement, ASTStatement)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTExpression> GetASTExpression();
+	ASTExpression &GetASTExpression();
 };
 class ASTWhileStatement : public ASTStatement {
-	using ASTStatement::ASTStatement;
+	DECLARE_AST_KIND(ASTWhileStatement, ASTWhileStatement)
+	DECLARE_AST_CTOR(ASTWhileStatement, ASTStatement)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTExpression> GetASTExpression();
-	std::shared_ptr<ASTStatement> GetASTStatement();
+	ASTExpression &GetASTExpression();
+	ASTStatement &GetASTStatement();
 };
 class ASTIfElseStatement : public ASTStatement {
-	using ASTStatement::ASTStatement;
+	DECLARE_AST_KIND(ASTIfElseStatement, ASTIfElseStatement)
+	DECLARE_AST_CTOR(ASTIfElseStatement, ASTStatement)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTExpression> GetASTExpression();
-	std::shared_ptr<ASTStatement> GetThenASTStatement();
-	std::shared_ptr<ASTStatement> GetElseASTStatement();
+	ASTExpression &GetASTExpression();
+	ASTStatement &GetThenASTStatement();
+	ASTStatement &GetElseASTStatement();
 };
 class ASTBlockStatement : public ASTStatement {
-	using ASTStatement::ASTStatement;
+	DECLARE_AST_KIND(ASTBlockStatement, ASTBlockStatement)
+	DECLARE_AST_CTOR(ASTBlockStatement, ASTStatement)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
 };
@@ -205,6 +383,7 @@ public:
 class TypeInfo;
 
 class ASTType : public ASTNode {
+	DECLARE_AST_KIND(ASTType, ASTType)
 public:
 	enum VarType {
 		VT_UNKNOWN,
@@ -220,7 +399,7 @@ public:
 	const char *GetTypeName();
 	static const char *GetTypeName(VarType type);
 	TypeInfo GetTypeInfo();
-	std::shared_ptr<ASTIdentifier> GetASTIdentifier();
+	ASTIdentifier &GetASTIdentifier();
 	data_off_t GetTypeSize();
 };
 
@@ -228,12 +407,14 @@ public:
 // ASTArgDeclarationList
 class VarDeclList;
 class ASTArgDeclarationList1 : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTArgDeclarationList1, ASTArgDeclarationList1)
+	DECLARE_AST_CTOR(ASTArgDeclarationList1, ASTNode)
 public:
-	VarDeclList GetVarDeclList(VarDeclList base);
+	VarDeclList GetVarDeclList(CompilationContext &ctx, VarDeclList base);
 };
 class ASTArgDeclarationList2 : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTArgDeclarationList2, ASTArgDeclarationList2)
+	DECLARE_AST_CTOR(ASTArgDeclarationList2, ASTNode)
 };
 
 
@@ -242,60 +423,67 @@ class ASTArgDeclarationList2 : public ASTNode {
 class MethodDeclList;
 class ASTVarDeclarationList;
 class ASTMethodDeclaration : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTMethodDeclaration, ASTMethodDeclaration)
+	DECLARE_AST_CTOR(ASTMethodDeclaration, ASTNode)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTType> GetASTType();
-	std::shared_ptr<ASTIdentifier> GetASTIdentifier();
-	std::shared_ptr<ASTArgDeclarationList1> GetASTArgDeclarationList1();
-	std::shared_ptr<ASTVarDeclarationList> GetASTVarDeclarationList();
-	std::shared_ptr<ASTStatementList> GetASTStatementList();
-	std::shared_ptr<ASTExpression> GetASTExpression();
+	ASTType &GetASTType();
+	ASTIdentifier &GetASTIdentifier();
+	ASTArgDeclarationList1 &GetASTArgDeclarationList1();
+	ASTVarDeclarationList &GetASTVarDeclarationList();
+	ASTStatementList &GetASTStatementList();
+	ASTExpression &GetASTExpression();
 };
 class ASTMethodDeclarationList : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTMethodDeclarationList, ASTMethodDeclarationList)
+	DECLARE_AST_CTOR(ASTMethodDeclarationList, ASTNode)
 public:
-	MethodDeclList GetMethodDeclList(MethodDeclList base, const std::string &clsname);
+	MethodDeclList GetMethodDeclList(CompilationContext &ctx, MethodDeclList base, Symbol clsname);
 };
 
 
 // ASTVarDeclaration
 class VarDeclList;
 class ASTVarDeclaration : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTVarDeclaration, ASTVarDeclaration)
+	DECLARE_AST_CTOR(ASTVarDeclaration, ASTNode)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTType> GetASTType();
-	std::shared_ptr<ASTIdentifier> GetASTIdentifier();
+	ASTType &GetASTType();
+	ASTIdentifier &GetASTIdentifier();
 };
 
 class ASTVarDeclarationList : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTVarDeclarationList, ASTVarDeclarationList)
+	DECLARE_AST_CTOR(ASTVarDeclarationList, ASTNode)
 public:
-	VarDeclList GetVarDeclList(VarDeclList base);
+	VarDeclList GetVarDeclList(CompilationContext &ctx, VarDeclList base);
 };
 
 
 // ASTClassDeclaration
 class ASTClassDeclaration : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTClassDeclaration, ASTClassDeclaration)
+	DECLARE_AST_CTOR(ASTClassDeclaration, ASTNode)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTIdentifier> GetASTIdentifier();
-	std::shared_ptr<ASTVarDeclarationList> GetASTVarDeclarationList();
-	std::shared_ptr<ASTMethodDeclarationList> GetASTMethodDeclarationList();
+	ASTIdentifier &GetASTIdentifier();
+	ASTVarDeclarationList &GetASTVarDeclarationList();
+	ASTMethodDeclarationList &GetASTMethodDeclarationList();
 };
 class ASTDerivedClassDeclaration : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTDerivedClassDeclaration, ASTDerivedClassDeclaration)
+	DECLARE_AST_CTOR(ASTDerivedClassDeclaration, ASTNode)
 public:
 	virtual void Accept(ASTNodeVisitor &visitor, int level) override;
-	std::shared_ptr<ASTIdentifier> GetASTIdentifier();
-	std::shared_ptr<ASTIdentifier> GetBaseASTIdentifier();
-	std::shared_ptr<ASTVarDeclarationList> GetASTVarDeclarationList();
-	std::shared_ptr<ASTMethodDeclarationList> GetASTMethodDeclarationList();
+	ASTIdentifier &GetASTIdentifier();
+	ASTIdentifier &GetBaseASTIdentifier();
+	ASTVarDeclarationList &GetASTVarDeclarationList();
+	ASTMethodDeclarationList &GetASTMethodDeclarationList();
 };
 class ASTClassDeclarationList : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTClassDeclarationList, ASTClassDeclarationList)
+	DECLARE_AST_CTOR(ASTClassDeclarationList, ASTNode)
 };
 
 
@@ -303,18 +491,21 @@ class ASTClassDeclarationList : public ASTNode {
 
 // ASTMainClass
 class ASTMainClass : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTMainClass, ASTMainClass)
+	DECLARE_AST_CTOR(ASTMainClass, ASTNode)
 public:
-	std::shared_ptr<ASTStatement> GetASTStatement();
+	ASTIdentifier &GetASTIdentifier();
+	ASTStatement &GetASTStatement();
 };
 
 // ASTGoal
 class ClassInfoList;
 class ASTGoal : public ASTNode {
-	using ASTNode::ASTNode;
+	DECLARE_AST_KIND(ASTGoal, ASTGoal)
+	DECLARE_AST_CTOR(ASTGoal, ASTNode)
 public:
-	ClassInfoList GetClassInfoList();
-	std::shared_ptr<ASTMainClass> GetASTMainClass();
+	ClassInfoList GetClassInfoList(CompilationContext &ctx);
+	ASTMainClass &GetASTMainClass();
 };
 
 
@@ -357,42 +548,129 @@ public:
 };
 
 
-class PrintVisitor : public ASTNodeVisitor {
-	FILE *fp;
-	bool dumpcontent;
+//////////////// ASTNode static visitor ////////////////
 
-	virtual void Visit(ASTNode *node, int level) override;
-	virtual void Visit(ASTIdentifier *node, int level) override;
-	virtual void Visit(ASTBoolean *node, int level) override;
-	virtual void Visit(ASTNumber *node, int level) override;
-	virtual void Visit(ASTBinaryExpression *node, int level) override;
-	virtual void Visit(ASTUnaryExpression *node, int level) override;
-	virtual void Visit(ASTType *node, int level) override;
+// dispatches with one switch on ASTNode::kind instead of the Accept/Visit virtual calls,
+// Derived declares "using ASTStaticVisitor<Derived>::Visit;" and overloads what it handles,
+// an overload it does not provide falls back to the one for the base class
+template <class Derived>
+class ASTStaticVisitor {
+protected:
+	void VisitChildren(ASTNode *node, int level)
+	{
+		for (auto ch: node->ch) {
+			Dispatch(ch, level + 1);
+		}
+	}
+public:
+	void Dispatch(ASTNode *node, int level = 0)
+	{
+		Derived *self = static_cast<Derived *>(this);
+		switch (node->kind) {
+			case ASTNodeKind::ASTNode: self->Visit(node, level); break;
+#define MAKE_DISPATCH(cls, super) case ASTNodeKind::cls: self->Visit(static_cast<cls *>(node), level); break;
+			AST_NODE_KIND_LIST(MAKE_DISPATCH)
+#undef MAKE_DISPATCH
+			default: panic();
+		}
+	}
+
+	void Visit(ASTNode *node, int level)
+	{
+		VisitChildren(node, level);
+	}
+#define MAKE_STATIC_VISIT(cls, super) \
+	void Visit(cls *node, int level) \
+	{ \
+		static_cast<Derived *>(this)->Visit(static_cast<super *>(node), level); \
+	}
+	AST_NODE_KIND_LIST(MAKE_STATIC_VISIT)
+#undef MAKE_STATIC_VISIT
+};
+
+
+class PrintVisitor : public ASTStaticVisitor<PrintVisitor> {
+	friend ASTStaticVisitor<PrintVisitor>;
+	using ASTStaticVisitor<PrintVisitor>::Visit;
+
+	// a node line of the interleaved dump, waiting for its source line
+	struct Note {
+		size_t line;
+		size_t begin, end; // range in text
+	};
+
+	CompilationContext &ctx;
+	OutputBuffer *out;
+	bool dumpcontent; // source excerpt below every node
+	bool interleave; // source lines once, node lines after the line they start on
+	std::string info; // the text after the node's type name
+	std::string text; // node lines of the interleaved dump
+	std::vector<Note> notes;
+
+	void OutInterleaved();
+	void Visit(ASTNode *node, int level);
+	void Visit(ASTIdentifier *node, int level);
+	void Visit(ASTBoolean *node, int level);
+	void Visit(ASTNumber *node, int level);
+	void Visit(ASTBinaryExpression *node, int level);
+	void Visit(ASTUnaryExpression *node, int level);
+	void Visit(ASTType *node, int level);
 	void Visit(ASTNode *node, int level, std::function<void()> func);
 
 public:
-	void DumpASTToTextFile(const char *txtfile, ASTNode *root, bool dumpcontent);
+	PrintVisitor(CompilationContext &ctx);
+	// dumpcontent interleaves the source, each line printed once, size stays linear in the program
+	bool DumpASTToTextFile(const char *txtfile, ASTNode *root, bool dumpcontent);
+	// dumpcontent prints the source excerpt of every node, for debugging small subtrees
 	void DumpTree(ASTNode *root, bool dumpcontent);
 };
 
-class JSONVisitor : public ASTNodeVisitor {
-	FILE *fp;
+class JSONVisitor : public ASTStaticVisitor<JSONVisitor> {
+	friend ASTStaticVisitor<JSONVisitor>;
+	using ASTStaticVisitor<JSONVisitor>::Visit;
 
-	void OutEscapedString(const char *s);
-	void OutQuotedString(const char *s);
-
-	void OutKeyValue(const char *key, const char *value);
-	void OutKeyValue(const char *key, int value);
+	// a part of the indexed export loaded on its own
+	struct Chunk {
+		ASTNode *node;
+		uint32_t first, last; // a page of node's children, or the node itself if equal
+		size_t parent; // chunk holding the stub or page reference
+		size_t offset, length, nodes;
+	};
 
-	virtual void Visit(ASTNode *node, int level) override;
-	virtual void Visit(ASTIdentifier *node, int level) override;
-	virtual void Visit(ASTBoolean *node, int level) override;
-	virtual void Visit(ASTNumber *node, int level) override;
-	virtual void Visit(ASTBinaryExpression *node, int level) override;
-	virtual void Visit(ASTUnaryExpression *node, int level) override;
-	virtual void Visit(ASTType *node, int level) override;
+	CompilationContext &ctx;
+	OutputBuffer *out;
+	bool cbor; // CBOR instead of JSON
+	bool need_comma; // a JSON list element was written at this level
+	std::string info; // the "info" text of the node being written
+	bool indexing = false; // writing the indexed export
+	std::vector<Chunk> chunks; // still to write or written
+	std::unordered_map<ASTNode *, std::vector<uint32_t> > pages; // first child of each page, for nodes with too many descendants
+	size_t cur_chunk;
+	size_t node_count;
+
+	void OutEscapedString(const char *s, size_t len);
+	void OutLocation(const yylinecol &loc);
+	void OutIndexEntry(ASTNode *node, size_t chunk);
+	size_t PlanPages(ASTNode *node);
+	bool IsChunkRoot(ASTNode *node);
+	void VisitPages(ASTNode *node, const std::vector<uint32_t> &first);
+	void OutCBORHead(uint8_t major, uint64_t value);
+	void OutCBORText(const char *s, size_t len);
+
+	void Visit(ASTNode *node, int level);
+	void Visit(ASTIdentifier *node, int level);
+	void Visit(ASTBoolean *node, int level);
+	void Visit(ASTNumber *node, int level);
+	void Visit(ASTBinaryExpression *node, int level);
+	void Visit(ASTUnaryExpression *node, int level);
+	void Visit(ASTType *node, int level);
 	void Visit(ASTNode *node, int level, std::function<void()> func);
 
 public:
-	void DumpASTToJSON(const char *jsonfile, ASTNode *root, const std::vector<std::string> &lines);
+	JSONVisitor(CompilationContext &ctx);
+	// both stream to any FILE *, pipes included, and return false on write errors
+	bool DumpASTToJSON(FILE *fp, ASTNode *root, const char *src, size_t srclen);
+	bool DumpASTToCBOR(FILE *fp, ASTNode *root, const char *src, size_t srclen);
+	// the JSON tree cut into separately loadable chunks behind a header of byte ranges
+	bool DumpASTToIndex(FILE *fp, ASTNode *root, const char *src, size_t srclen);
 };
\ No newline at end of file
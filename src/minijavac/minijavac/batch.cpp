@@ -0,0 +1,218 @@
+#include "common.h"
+
+////////// WorkStealingPool //////////
+
+WorkStealingPool::WorkStealingPool(size_t nthread) : steals(0)
+{
+	if (nthread < 1) nthread = 1;
+	for (size_t i = 0; i < nthread; i++) {
+		workers.emplace_back(new Worker);
+	}
+}
+size_t WorkStealingPool::GetThreadCount()
+{
+	return workers.size();
+}
+size_t WorkStealingPool::GetStealCount()
+{
+	return steals;
+}
+
+void WorkStealingPool::Submit(std::function<void()> task)
+{
+	workers[next]->tasks.push_back(std::move(task));
+	next = (next + 1) % workers.size();
+}
+
+bool WorkStealingPool::Pop(size_t self, std::function<void()> &task)
+{
+	Worker &w = *workers[self];
+	std::lock_guard<std::mutex> guard(w.lock);
+	if (w.tasks.empty()) return false;
+	task = std::move(w.tasks.front());
+	w.tasks.pop_front();
+	return true;
+}
+bool WorkStealingPool::Steal(size_t self, std::function<void()> &task)
+{
+	for (size_t k = 1; k < workers.size(); k++) {
+		Worker &w = *workers[(self + k) % workers.size()];
+		std::lock_guard<std::mutex> guard(w.lock);
+		if (!w.tasks.empty()) {
+			task = std::move(w.tasks.front());
+			w.tasks.pop_front();
+			steals++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::WorkerMain(size_t self)
+{
+	// tasks never submit new tasks, so once every deque is empty there is nothing left to wait for
+	std::function<void()> task;
+	while (Pop(self, task) || Steal(self, task)) {
+		task();
+	}
+}
+
+void WorkStealingPool::Run()
+{
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < workers.size(); i++) {
+		threads.emplace_back(&WorkStealingPool::WorkerMain, this, i);
+	}
+	WorkerMain(0);
+	for (auto &t: threads) {
+		t.join();
+	}
+}
+
+
+////////// batch mode //////////
+
+class BatchJob {
+public:
+	std::string src;
+	std::string outbase;
+	size_t filesize = 0;
+	size_t lines = 0;
+	int errors = 0;
+	double sec = 0;
+};
+
+static void CollectSources(const std::string &path, std::vector<std::string> &files)
+{
+	DWORD attr = GetFileAttributesA(path.c_str());
+	if (attr == INVALID_FILE_ATTRIBUTES || !(attr & FILE_ATTRIBUTE_DIRECTORY)) {
+		files.push_back(path);
+		return;
+	}
+
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA((path + "\\*").c_str(), &fd);
+	if (h == INVALID_HANDLE_VALUE) return;
+	do {
+		std::string name = fd.cFileName;
+		if (name == "." || name == "..") continue;
+		std::string sub = path + "\\" + name;
+		if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			CollectSources(sub, files);
+		} else if (name.size() > 5 && name.compare(name.size() - 5, 5, ".java") == 0) {
+			files.push_back(sub);
+		}
+	} while (FindNextFileA(h, &fd));
+	FindClose(h);
+}
+
+static std::string GetOutputName(const std::string &src, std::map<std::string, int> &used)
+{
+	size_t slash = src.find_last_of("\\/");
+	std::string name = slash == std::string::npos ? src : src.substr(slash + 1);
+	if (name.size() > 5 && name.compare(name.size() - 5, 5, ".java") == 0) {
+		name.resize(name.size() - 5);
+	}
+	// same file name in different directories: Foo, Foo-2, Foo-3, ...
+	int n = ++used[name];
+	if (n > 1) {
+		name += "-" + std::to_string(n);
+	}
+	return name;
+}
+
+static void CompileJob(BatchJob &job, const BatchOptions &opt)
+{
+	PhaseTimer t;
+	CompilationContext cc;
+	cc.show_timing = opt.show_timing;
+	cc.jobs = 1; // the jobs already keep every thread busy
+
+	FILE *log = fopen((job.outbase + ".log.txt").c_str(), "w");
+	if (!log) {
+		job.errors = 1;
+		return;
+	}
+	cc.log = log;
+
+	cc.LoadFile(job.src.c_str());
+	if (cc.src_loaded) {
+		job.filesize = cc.GetSourceSize();
+		job.lines = cc.GetLineCount();
+		cc.Compile(job.outbase, opt.emit);
+	}
+	job.errors = cc.error_count;
+	if (job.errors) {
+		fprintf(log, "\n%d error(s) occured, compile failed.\n\n", job.errors);
+	} else {
+		fprintf(log, "\nCompile successful.\n\n");
+	}
+	fclose(log);
+	job.sec = t.Elapsed();
+}
+
+int RunBatch(const BatchOptions &opt, int argc, char *argv[])
+{
+	std::vector<std::string> files;
+	for (int i = 0; i < argc; i++) {
+		CollectSources(argv[i], files);
+	}
+	if (files.empty()) {
+		printf("ERROR : no source file.\n");
+		return 1;
+	}
+	CreateDirectoryA(opt.outdir.c_str(), NULL);
+
+	std::vector<BatchJob> jobs(files.size());
+	std::map<std::string, int> used;
+	for (size_t i = 0; i < files.size(); i++) {
+		jobs[i].src = files[i];
+		jobs[i].outbase = opt.outdir + "\\" + GetOutputName(files[i], used);
+		WIN32_FILE_ATTRIBUTE_DATA fa;
+		if (GetFileAttributesExA(files[i].c_str(), GetFileExInfoStandard, &fa)) {
+			jobs[i].filesize = fa.nFileSizeLow;
+		}
+	}
+
+	// largest first: tasks are dealt round-robin and taken from the front by owners and thieves alike,
+	// so an idle worker always picks the largest file left in a deque and the small ones fill in at the end
+	std::vector<BatchJob *> order;
+	for (auto &job: jobs) {
+		order.push_back(&job);
+	}
+	std::stable_sort(order.begin(), order.end(), [](BatchJob *a, BatchJob *b) {
+		return a->filesize > b->filesize;
+	});
+
+	size_t nthread = opt.jobs > 0 ? opt.jobs : std::thread::hardware_concurrency();
+	WorkStealingPool pool(std::min(nthread, files.size()));
+	for (auto job: order) {
+		pool.Submit([job, &opt] { CompileJob(*job, opt); });
+	}
+
+	printf("[*] Compiling %u files on %u threads ...\n", (unsigned) jobs.size(), (unsigned) pool.GetThreadCount());
+	PhaseTimer t;
+	pool.Run();
+	double sec = t.Elapsed();
+
+	size_t failed = 0, lines = 0, bytes = 0;
+	double busy = 0;
+	for (auto &job: jobs) {
+		if (job.errors) {
+			printf("FAILED : %s, %d error(s), see %s.log.txt\n", job.src.c_str(), job.errors, job.outbase.c_str());
+			failed++;
+		}
+		lines += job.lines;
+		bytes += job.filesize;
+		busy += job.sec;
+	}
+
+	printf("\n[*] %u files compiled, %u failed, in %.3f s\n", (unsigned) jobs.size(), (unsigned) failed, sec);
+	printf("[*] %.1f files/s, %.0f lines/s, %.2f MB/s\n", jobs.size() / sec, lines / sec, bytes / 1048576.0 / sec);
+	if (opt.show_timing) {
+		printf(" [*] %.3f s summed over jobs (%.2fx wall time) on %u threads, %u tasks stolen\n",
+			busy, busy / sec, (unsigned) pool.GetThreadCount(), (unsigned) pool.GetStealCount());
+	}
+	printf("\n");
+	return !!failed;
+}
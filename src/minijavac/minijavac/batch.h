@@ -0,0 +1,41 @@
+#pragma once
+
+////////// WorkStealingPool //////////
+
+// fixed set of worker threads for a batch of independent tasks submitted up front,
+// each worker takes its own tasks in submission order and steals the oldest task of the others
+class WorkStealingPool {
+	struct Worker {
+		std::deque<std::function<void()> > tasks;
+		std::mutex lock;
+	};
+	std::vector<std::unique_ptr<Worker> > workers;
+	size_t next = 0; // worker receiving the next submitted task
+	std::atomic<size_t> steals;
+private:
+	bool Pop(size_t self, std::function<void()> &task);
+	bool Steal(size_t self, std::function<void()> &task);
+	void WorkerMain(size_t self);
+public:
+	WorkStealingPool(size_t nthread);
+	size_t GetThreadCount();
+	size_t GetStealCount();
+	void Submit(std::function<void()> task); // not allowed while Run() is active
+	void Run(); // returns when every submitted task has finished
+};
+
+
+////////// batch mode //////////
+
+class BatchOptions {
+public:
+	int jobs = 0; // 0 = one per hardware thread
+	std::string outdir = ".";
+	bool show_timing = false;
+	unsigned emit = EMIT_EXE | EMIT_ASM | EMIT_VARS;
+};
+
+// minijavac --batch [--jobs n] [--out dir] <file|dir>...
+// compiles every .java file given or found below the given directories,
+// each into <outdir>/<name>.log.txt and the artifacts selected by --emit (default exe,vars,asm)
+int RunBatch(const BatchOptions &opt, int argc, char *argv[]);
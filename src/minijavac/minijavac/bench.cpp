@@ -0,0 +1,651 @@
+#include "common.h"
+
+std::string GenerateBenchProgram(int nclass, int nmethod, int nstmt)
+{
+	std::string s;
+	char buf[256];
+
+	s += "class BenchMain {\n";
+	s += "\tpublic static void main(String[] a) {\n";
+	s += "\t\tSystem.out.println(new C0().m0(1));\n";
+	s += "\t}\n";
+	s += "}\n";
+
+	for (int c = 0; c < nclass; c++) {
+		sprintf(buf, "class C%d {\n\tint f;\n\tint[] arr;\n\tC%d next;\n", c, c);
+		s += buf;
+		for (int m = 0; m < nmethod; m++) {
+			sprintf(buf, "\tpublic int m%d(int x) {\n\t\tint y;\n\t\tint[] t;\n\t\tt = new int[10];\n\t\ty = x;\n", m);
+			s += buf;
+			for (int i = 0; i < nstmt; i++) {
+				switch (i % 6) {
+					case 0: s += "\t\ty = y + x * 2 - 1;\n"; break;
+					case 1: s += "\t\tt[y - y] = y + t.length;\n"; break;
+					case 2: s += "\t\tif (y < 100 && !(x < 0)) y = y + t[0]; else y = y - 1;\n"; break;
+					case 3: s += "\t\twhile (y < 10) { y = y + 1; f = f + y; }\n"; break;
+					case 4: s += "\t\tSystem.out.println(y);\n"; break;
+					case 5:
+						sprintf(buf, "\t\tf = this.m%d(y);\n", (m + 1) % nmethod);
+						s += buf;
+						break;
+				}
+			}
+			s += "\t\treturn y;\n\t}\n";
+		}
+		s += "}\n";
+	}
+	return s;
+}
+
+static double GetPeakMemoryMB()
+{
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+		return 0;
+	}
+	return pmc.PeakWorkingSetSize / 1048576.0;
+}
+
+static int BenchParse(int argc, char *argv[])
+{
+	int nclass = argc > 0 ? atoi(argv[0]) : 100;
+	int nmethod = argc > 1 ? atoi(argv[1]) : 20;
+	int nstmt = argc > 2 ? atoi(argv[2]) : 50;
+
+	std::string prog = GenerateBenchProgram(nclass, nmethod, nstmt);
+	CompilationContext cc;
+	cc.LoadBuffer(prog.data(), prog.size());
+
+	PhaseTimer t;
+	cc.ParseAST();
+	double sec = t.Elapsed();
+
+	if (!cc.goal) {
+		printf("parse failed\n");
+		return 1;
+	}
+	double mb = cc.GetSourceSize() / 1048576.0;
+	size_t lines = cc.GetLineCount();
+	size_t nodes = cc.pool->GetNodeCount();
+	printf("parser:     %s\n", yyskeleton);
+	printf("source:     %.2f MB, %u lines\n", mb, (unsigned) lines);
+	printf("parse time: %.3f s\n", sec);
+	printf("throughput: %.2f MB/s, %.0f lines/s\n", mb / sec, lines / sec);
+	printf("AST nodes:  %u, %.0f nodes/s\n", (unsigned) nodes, nodes / sec);
+	printf("arena:      %.2f MB used, %.2f MB reserved\n", cc.pool->GetUsedSize() / 1048576.0, cc.pool->GetReservedSize() / 1048576.0);
+	printf("peak RSS:   %.2f MB\n", GetPeakMemoryMB());
+
+	cc.goal = nullptr;
+	t = PhaseTimer();
+	cc.pool->Release();
+	printf("release:    %.3f ms\n", t.Elapsed() * 1000);
+	return 0;
+}
+
+// parse the same program once on this thread, then once on each of nthread threads at the same time,
+// every parse has its own CompilationContext, source copy and AST arena
+static int BenchParseThreads(int argc, char *argv[])
+{
+	int nthread = argc > 0 ? atoi(argv[0]) : (int) std::thread::hardware_concurrency();
+	int nclass = argc > 1 ? atoi(argv[1]) : 100;
+	int nmethod = argc > 2 ? atoi(argv[2]) : 20;
+	int nstmt = argc > 3 ? atoi(argv[3]) : 50;
+	if (nthread < 1) nthread = 1;
+
+	std::string prog = GenerateBenchProgram(nclass, nmethod, nstmt);
+	std::vector<size_t> nodes(nthread + 1);
+	auto parse = [&](int i) {
+		std::vector<char> buf(prog.begin(), prog.end());
+		buf.push_back(0);
+		buf.push_back(0);
+		CompilationContext cc;
+		ASTNodePool::Scope scope(cc.pool);
+		ParseContext ctx(&cc);
+		if (ctx.Parse(buf.data(), buf.size())) {
+			nodes[i] = cc.pool->GetNodeCount();
+		}
+	};
+
+	PhaseTimer t;
+	parse(nthread);
+	double serial = t.Elapsed();
+
+	std::vector<std::thread> workers;
+	t = PhaseTimer();
+	for (int i = 0; i < nthread; i++) {
+		workers.emplace_back(parse, i);
+	}
+	for (auto &w: workers) {
+		w.join();
+	}
+	double parallel = t.Elapsed();
+
+	for (auto n: nodes) {
+		if (n != nodes[nthread] || !n) {
+			printf("parse failed\n");
+			return 1;
+		}
+	}
+	double mb = prog.size() / 1048576.0;
+	printf("parser:     %s\n", yyskeleton);
+	printf("source:     %.2f MB, %u AST nodes\n", mb, (unsigned) nodes[nthread]);
+	printf("1 thread:   %.3f s, %.2f MB/s\n", serial, mb / serial);
+	printf("%d threads: %.3f s, %.2f MB/s, %.2fx\n", nthread, parallel, mb * nthread / parallel, serial * nthread / parallel);
+	return 0;
+}
+
+// both walkers count every node through the base-class fallback chain
+class BenchVirtualWalker : public ASTNodeVisitor {
+public:
+	size_t nodes = 0, idents = 0;
+	virtual void Visit(ASTNode *node, int level) override
+	{
+		nodes++;
+		VisitChildren(node, level);
+	}
+	virtual void Visit(ASTIdentifier *node, int level) override
+	{
+		idents++;
+		ASTNodeVisitor::Visit(node, level);
+	}
+};
+
+class BenchStaticWalker : public ASTStaticVisitor<BenchStaticWalker> {
+public:
+	using ASTStaticVisitor<BenchStaticWalker>::Visit;
+	size_t nodes = 0, idents = 0;
+	void Visit(ASTNode *node, int level)
+	{
+		nodes++;
+		VisitChildren(node, level);
+	}
+	void Visit(ASTIdentifier *node, int level)
+	{
+		idents++;
+		Visit(static_cast<ASTExpression *>(node), level);
+	}
+};
+
+static int BenchWalk(int argc, char *argv[])
+{
+	int nclass = argc > 0 ? atoi(argv[0]) : 100;
+	int nmethod = argc > 1 ? atoi(argv[1]) : 20;
+	int nstmt = argc > 2 ? atoi(argv[2]) : 50;
+	int rounds = argc > 3 ? atoi(argv[3]) : 10;
+
+	std::string prog = GenerateBenchProgram(nclass, nmethod, nstmt);
+	CompilationContext cc;
+	cc.LoadBuffer(prog.data(), prog.size());
+	cc.ParseAST();
+	ASTGoal *goal = cc.goal;
+	if (!goal) {
+		printf("parse failed\n");
+		return 1;
+	}
+
+	BenchVirtualWalker vw;
+	PhaseTimer t;
+	for (int i = 0; i < rounds; i++) {
+		goal->Accept(vw);
+	}
+	double vsec = t.Elapsed();
+
+	BenchStaticWalker sw;
+	t = PhaseTimer();
+	for (int i = 0; i < rounds; i++) {
+		sw.Dispatch(goal);
+	}
+	double ssec = t.Elapsed();
+
+	if (vw.nodes != sw.nodes || vw.idents != sw.idents) {
+		printf("walkers disagree\n");
+		return 1;
+	}
+	double mnodes = vw.nodes / 1e6;
+	printf("AST nodes:  %u x %d rounds\n", (unsigned) (vw.nodes / rounds), rounds);
+	printf("virtual:    %.3f s, %.1f M nodes/s\n", vsec, mnodes / vsec);
+	printf("switch:     %.3f s, %.1f M nodes/s\n", ssec, mnodes / ssec);
+	return 0;
+}
+
+class BenchFlatWalker : public FlatASTVisitor<BenchFlatWalker> {
+public:
+	using FlatASTVisitor<BenchFlatWalker>::Visit;
+	size_t nodes = 0, idents = 0;
+	void Visit(FlatASTNode<ASTNode> node, int level)
+	{
+		nodes++;
+		VisitChildren(node, level);
+	}
+	void Visit(FlatASTNode<ASTIdentifier> node, int level)
+	{
+		idents++;
+		Visit(FlatASTNode<ASTExpression>(node), level);
+	}
+};
+
+static int BenchFlat(int argc, char *argv[])
+{
+	int nclass = argc > 0 ? atoi(argv[0]) : 100;
+	int nmethod = argc > 1 ? atoi(argv[1]) : 20;
+	int nstmt = argc > 2 ? atoi(argv[2]) : 50;
+	int rounds = argc > 3 ? atoi(argv[3]) : 10;
+
+	std::string prog = GenerateBenchProgram(nclass, nmethod, nstmt);
+	CompilationContext cc;
+	cc.LoadBuffer(prog.data(), prog.size());
+	cc.ParseAST();
+	ASTGoal *goal = cc.goal;
+	if (!goal) {
+		printf("parse failed\n");
+		return 1;
+	}
+
+	FlatAST flat;
+	PhaseTimer t;
+	flat.Build(goal, nullptr, cc.pool->GetNodeCount());
+	double bsec = t.Elapsed();
+
+	BenchStaticWalker sw;
+	t = PhaseTimer();
+	for (int i = 0; i < rounds; i++) {
+		sw.Dispatch(goal);
+	}
+	double ssec = t.Elapsed();
+
+	BenchFlatWalker fw;
+	t = PhaseTimer();
+	for (int i = 0; i < rounds; i++) {
+		fw.Walk(flat);
+	}
+	double fsec = t.Elapsed();
+
+	if (sw.nodes != fw.nodes || sw.idents != fw.idents) {
+		printf("walkers disagree\n");
+		return 1;
+	}
+	size_t nodes = flat.size();
+	double mnodes = sw.nodes / 1e6;
+	size_t ptrsize = cc.pool->GetUsedSize() + cc.pool->GetNodeCount() * sizeof(ASTNode *);
+	printf("AST nodes:  %u x %d rounds\n", (unsigned) nodes, rounds);
+	printf("memory:     ASTNode %.2f MB (%.1f B/node), FlatAST %.2f MB (%.1f B/node)\n",
+		ptrsize / 1048576.0, (double) ptrsize / nodes, flat.GetMemorySize() / 1048576.0, (double) flat.GetMemorySize() / nodes);
+	printf("build:      %.3f s\n", bsec);
+	printf("ASTNode:    %.3f s, %.1f M nodes/s\n", ssec, mnodes / ssec);
+	printf("FlatAST:    %.3f s, %.1f M nodes/s\n", fsec, mnodes / fsec);
+	return 0;
+}
+
+static int BenchCompile(int argc, char *argv[])
+{
+	int count = argc > 0 ? atoi(argv[0]) : 1000;
+	int nclass = argc > 1 ? atoi(argv[1]) : 3;
+	int nmethod = argc > 2 ? atoi(argv[2]) : 3;
+	int nstmt = argc > 3 ? atoi(argv[3]) : 6;
+
+	std::string prog = GenerateBenchProgram(nclass, nmethod, nstmt);
+
+	// what a test harness did before: one context per snippet, outputs written next to it
+	PhaseTimer t;
+	for (int i = 0; i < count; i++) {
+		CompilationContext cc;
+		cc.log = nullptr;
+		cc.LoadBuffer(prog.data(), prog.size());
+		cc.Compile("bench", EMIT_EXE | EMIT_ASM | EMIT_VARS);
+		if (cc.error_count) {
+			printf("compile failed\n");
+			return 1;
+		}
+	}
+	double fsec = t.Elapsed();
+
+	size_t imgsize = 0;
+	t = PhaseTimer();
+	for (int i = 0; i < count; i++) {
+		CompileResult r = Compile(prog.data(), prog.size());
+		if (r.error_count) {
+			printf("compile failed\n");
+			return 1;
+		}
+		imgsize = r.image.size();
+	}
+	double msec = t.Elapsed();
+
+	printf("snippet:    %u bytes source, %u bytes image, %d compiles\n", (unsigned) prog.size(), (unsigned) imgsize, count);
+	printf("files:      %.3f s, %.1f us/compile\n", fsec, fsec * 1e6 / count);
+	printf("in-memory:  %.3f s, %.1f us/compile\n", msec, msec * 1e6 / count);
+	return 0;
+}
+
+static int BenchEmit(int argc, char *argv[])
+{
+	int nclass = argc > 0 ? atoi(argv[0]) : 30;
+	int nmethod = argc > 1 ? atoi(argv[1]) : 10;
+	int nstmt = argc > 2 ? atoi(argv[2]) : 30;
+	int rounds = argc > 3 ? atoi(argv[3]) : 5;
+
+	std::string prog = GenerateBenchProgram(nclass, nmethod, nstmt);
+	struct {
+		const char *name;
+		unsigned emit;
+		bool background;
+	} runs[] = {
+		{ "exe", EMIT_EXE, true },
+		{ "all, inline", EMIT_ALL, false },
+		{ "all, writer", EMIT_ALL, true },
+	};
+
+	printf("program:    %u lines, %d rounds\n", (unsigned) std::count(prog.begin(), prog.end(), '\n'), rounds);
+	for (auto &run: runs) {
+		double best = 1e30;
+		for (int i = 0; i < rounds; i++) {
+			PhaseTimer t;
+			CompilationContext cc;
+			cc.log = nullptr;
+			cc.background_writer = run.background;
+			cc.LoadBuffer(prog.data(), prog.size());
+			cc.Compile("bench", run.emit);
+			if (cc.error_count) {
+				printf("compile failed\n");
+				return 1;
+			}
+			best = std::min(best, t.Elapsed());
+		}
+		printf("%-12s%.3f s\n", (std::string(run.name) + ":").c_str(), best);
+	}
+	return 0;
+}
+
+// CanCastTo as it was before ClassInfoList::BuildHierarchy(), one hash lookup per inheritance level
+static bool WalkCanCastTo(const TypeInfo &l, const TypeInfo &r, ClassInfoList &clsinfo)
+{
+	Symbol curcls = l.clsname;
+	while (1) {
+		if (curcls == r.clsname) return true;
+		if (curcls.empty()) return false;
+		auto it = clsinfo.Find(curcls);
+		if (it == clsinfo.end()) return false;
+		curcls = it->base;
+	}
+}
+
+static int BenchCast(int argc, char *argv[])
+{
+	int depth = argc > 0 ? atoi(argv[0]) : 50;
+	int width = argc > 1 ? atoi(argv[1]) : 20;
+	int queries = argc > 2 ? atoi(argv[2]) : 1000000;
+	if (depth < 1) depth = 1;
+	if (width < 1) width = 1;
+
+	// width chains of depth classes each, H<w>_<d> extends H<w>_<d-1>
+	std::string prog = "class BenchMain {\n\tpublic static void main(String[] a) {\n\t\tSystem.out.println(1);\n\t}\n}\n";
+	char buf[128];
+	for (int w = 0; w < width; w++) {
+		for (int d = 0; d < depth; d++) {
+			if (d) {
+				sprintf(buf, "class H%d_%d extends H%d_%d {\n\tint f%d;\n}\n", w, d, w, d - 1, d);
+			} else {
+				sprintf(buf, "class H%d_0 {\n\tint f0;\n}\n", w);
+			}
+			prog += buf;
+		}
+	}
+
+	CompilationContext cc;
+	cc.log = nullptr;
+	cc.LoadBuffer(prog.data(), prog.size());
+	cc.ParseAST();
+	if (!cc.goal) {
+		printf("parse failed\n");
+		return 1;
+	}
+	ClassInfoList clsinfo = cc.goal->GetClassInfoList(cc);
+	PhaseTimer t;
+	clsinfo.BuildHierarchy();
+	double bsec = t.Elapsed();
+
+	// half the pairs share a chain, so both outcomes and all distances are exercised
+	std::vector<std::pair<TypeInfo, TypeInfo> > pairs(queries);
+	uint32_t seed = 12345;
+	auto next = [&seed](uint32_t n) { seed = seed * 1103515245 + 12345; return (seed >> 8) % n; };
+	for (auto &p: pairs) {
+		uint32_t a = next((uint32_t) clsinfo.size()), b = next((uint32_t) clsinfo.size());
+		if (next(2)) b = a / depth * depth + next(depth);
+		p.first.type = p.second.type = ASTType::VT_CLASS;
+		p.first.clsname = clsinfo[a].name;
+		p.second.clsname = clsinfo[b].name;
+	}
+
+	size_t wyes = 0, tyes = 0;
+	t = PhaseTimer();
+	for (auto &p: pairs) {
+		wyes += WalkCanCastTo(p.first, p.second, clsinfo);
+	}
+	double wsec = t.Elapsed();
+	t = PhaseTimer();
+	for (auto &p: pairs) {
+		tyes += p.first.CanCastTo(p.second, clsinfo);
+	}
+	double tsec = t.Elapsed();
+
+	for (auto &p: pairs) {
+		if (WalkCanCastTo(p.first, p.second, clsinfo) != p.first.CanCastTo(p.second, clsinfo)) {
+			printf("casts disagree: %s to %s\n", p.first.clsname.c_str(), p.second.clsname.c_str());
+			return 1;
+		}
+	}
+	printf("hierarchy:  %d chains x %d levels, %u classes, built in %.3f ms\n", width, depth, (unsigned) clsinfo.size(), bsec * 1000);
+	printf("queries:    %d, %u castable\n", queries, (unsigned) tyes);
+	printf("walk:       %.3f s, %.1f ns/query\n", wsec, wsec * 1e9 / queries);
+	printf("table:      %.3f s, %.1f ns/query\n", tsec, tsec * 1e9 / queries);
+	return wyes != tyes;
+}
+
+static int BenchMembers(int argc, char *argv[])
+{
+	int depth = argc > 0 ? atoi(argv[0]) : 200;
+	int nvar = argc > 1 ? atoi(argv[1]) : 20;
+	int nmethod = argc > 2 ? atoi(argv[2]) : 20;
+	int rounds = argc > 3 ? atoi(argv[3]) : 5;
+	if (depth < 1) depth = 1;
+
+	// one chain, every class adds nvar fields and nmethod methods, overriding half of its base's
+	std::string prog = "class BenchMain {\n\tpublic static void main(String[] a) {\n\t\tSystem.out.println(1);\n\t}\n}\n";
+	char buf[128];
+	for (int d = 0; d < depth; d++) {
+		if (d) {
+			sprintf(buf, "class C%d extends C%d {\n", d, d - 1);
+		} else {
+			sprintf(buf, "class C0 {\n");
+		}
+		prog += buf;
+		for (int i = 0; i < nvar; i++) {
+			sprintf(buf, "\tint f%d_%d;\n", d, i);
+			prog += buf;
+		}
+		for (int i = 0; i < nmethod; i++) {
+			int owner = (d && i % 2) ? d - 1 : d;
+			sprintf(buf, "\tpublic int m%d_%d(int x) {\n\t\treturn x;\n\t}\n", owner, i);
+			prog += buf;
+		}
+		prog += "}\n";
+	}
+
+	CompilationContext cc;
+	cc.log = nullptr;
+	cc.LoadBuffer(prog.data(), prog.size());
+	cc.ParseAST();
+	if (!cc.goal) {
+		printf("parse failed\n");
+		return 1;
+	}
+	double best = 1e30;
+	size_t members = 0;
+	for (int i = 0; i < rounds; i++) {
+		PhaseTimer t;
+		ClassInfoList clsinfo = cc.goal->GetClassInfoList(cc);
+		best = std::min(best, t.Elapsed());
+		members = 0;
+		for (auto &cls: clsinfo) {
+			members += cls.var.size() + cls.method.size();
+		}
+	}
+	if (cc.error_count) {
+		printf("class info failed\n");
+		return 1;
+	}
+	printf("hierarchy:  %d levels, %d fields and %d methods per class\n", depth, nvar, nmethod);
+	printf("members:    %u visible across all classes\n", (unsigned) members);
+	printf("class info: %.3f ms\n", best * 1000);
+	printf("peak RSS:   %.2f MB\n", GetPeakMemoryMB());
+	return 0;
+}
+
+static int BenchLookup(int argc, char *argv[])
+{
+	int nvar = argc > 0 ? atoi(argv[0]) : 300;
+	int nmethod = argc > 1 ? atoi(argv[1]) : 300;
+	int queries = argc > 2 ? atoi(argv[2]) : 1000000;
+	if (nvar < 1) nvar = 1;
+	if (nmethod < 1) nmethod = 1;
+
+	// one wide class whose methods have an argument and a local variable
+	std::string prog = "class BenchMain {\n\tpublic static void main(String[] a) {\n\t\tSystem.out.println(1);\n\t}\n}\nclass W {\n";
+	char buf[128];
+	for (int i = 0; i < nvar; i++) {
+		sprintf(buf, "\tint field_%d;\n", i);
+		prog += buf;
+	}
+	for (int i = 0; i < nmethod; i++) {
+		sprintf(buf, "\tpublic int method_%d(int x) {\n\t\tint y;\n\t\ty = x;\n\t\treturn y;\n\t}\n", i);
+		prog += buf;
+	}
+	prog += "}\n";
+
+	CompilationContext cc;
+	cc.log = nullptr;
+	cc.LoadBuffer(prog.data(), prog.size());
+	cc.ParseAST();
+	if (!cc.goal) {
+		printf("parse failed\n");
+		return 1;
+	}
+	ClassInfoList clsinfo = cc.goal->GetClassInfoList(cc);
+	clsinfo.BuildHierarchy();
+	const ClassInfoItem &cls = *clsinfo.Find(Symbol("W"));
+	const MethodDeclItem &method = *cls.method.begin();
+
+	// the index the lists kept before SharedNameIndexedList
+	std::unordered_map<Symbol, size_t> oldlists[4];
+	auto fill = [](std::unordered_map<Symbol, size_t> &map, const VarDeclList &list) {
+		for (auto it = list.begin(); it != list.end(); ++it) map.insert(std::make_pair(it->GetName(), it.GetPosition()));
+	};
+	fill(oldlists[0], method.localvar);
+	fill(oldlists[1], method.decl.arg);
+	fill(oldlists[2], cls.var);
+	for (auto it = cls.method.begin(); it != cls.method.end(); ++it) {
+		oldlists[3].insert(std::make_pair(it->GetName(), it.GetPosition()));
+	}
+
+	// locals and arguments, fields and methods, a quarter of the last two missing
+	std::vector<Symbol> names(queries);
+	uint32_t seed = 12345;
+	auto next = [&seed](uint32_t n) { seed = seed * 1103515245 + 12345; return (seed >> 8) % n; };
+	for (int i = 0; i < queries; i++) {
+		uint32_t kind = next(4);
+		if (kind == 0) {
+			strcpy(buf, next(2) ? "x" : "y");
+		} else {
+			bool m = kind == 3;
+			sprintf(buf, m ? "method_%d" : "field_%d", (int) next((uint32_t) (m ? nmethod : nvar) * 4 / 3 + 1));
+		}
+		names[i] = Symbol(buf);
+	}
+
+	// resolved the way an identifier is: local, argument, field, then method,
+	// each result is the list it was found in times 2^28 plus its position, or 0
+	std::vector<uint32_t> res[3];
+	double sec[3];
+	auto map_lookup = [&](Symbol name) -> uint32_t {
+		for (uint32_t l = 0; l < 4; l++) {
+			auto it = oldlists[l].find(name);
+			if (it != oldlists[l].end()) return ((l + 1) << 28) + (uint32_t) it->second;
+		}
+		return 0;
+	};
+	auto list_lookup = [&](Symbol name) -> uint32_t {
+		auto lvar = method.localvar.Find(name);
+		if (lvar != method.localvar.end()) return (1 << 28) + (uint32_t) lvar.GetPosition();
+		auto avar = method.decl.arg.Find(name);
+		if (avar != method.decl.arg.end()) return (2 << 28) + (uint32_t) avar.GetPosition();
+		auto mvar = cls.var.Find(name);
+		if (mvar != cls.var.end()) return (3 << 28) + (uint32_t) mvar.GetPosition();
+		auto mit = cls.method.Find(name);
+		if (mit != cls.method.end()) return (4 << 28) + (uint32_t) mit.GetPosition();
+		return 0;
+	};
+	for (int round = 0; round < 3; round++) {
+		if (round == 2) clsinfo.BuildIndex();
+		res[round].reserve(queries);
+		PhaseTimer t;
+		for (auto &name: names) {
+			res[round].push_back(round == 0 ? map_lookup(name) : list_lookup(name));
+		}
+		sec[round] = t.Elapsed();
+	}
+
+	size_t found = queries - std::count(res[0].begin(), res[0].end(), 0u);
+	static const char *labels[3] = { "unordered_map:", "shared trie:", "flat index:" };
+	printf("class:          %d fields, %d methods, lookups resolve locals, args, fields, then methods\n", nvar, nmethod);
+	printf("queries:        %d, %u found\n", queries, (unsigned) found);
+	for (int i = 0; i < 3; i++) {
+		printf("%-15s %.3f s, %.1f ns/query\n", labels[i], sec[i], sec[i] * 1e9 / queries);
+	}
+	if (res[1] != res[0] || res[2] != res[0]) {
+		printf("lookups disagree\n");
+		return 1;
+	}
+	return 0;
+}
+
+int RunBenchmark(int argc, char *argv[])
+{
+	if (argc >= 1 && strcmp(argv[0], "parse") == 0) {
+		return BenchParse(argc - 1, argv + 1);
+	}
+	if (argc >= 1 && strcmp(argv[0], "parse-mt") == 0) {
+		return BenchParseThreads(argc - 1, argv + 1);
+	}
+	if (argc >= 1 && strcmp(argv[0], "walk") == 0) {
+		return BenchWalk(argc - 1, argv + 1);
+	}
+	if (argc >= 1 && strcmp(argv[0], "flat") == 0) {
+		return BenchFlat(argc - 1, argv + 1);
+	}
+	if (argc >= 1 && strcmp(argv[0], "compile") == 0) {
+		return BenchCompile(argc - 1, argv + 1);
+	}
+	if (argc >= 1 && strcmp(argv[0], "emit") == 0) {
+		return BenchEmit(argc - 1, argv + 1);
+	}
+	if (argc >= 1 && strcmp(argv[0], "cast") == 0) {
+		return BenchCast(argc - 1, argv + 1);
+	}
+	if (argc >= 1 && strcmp(argv[0], "members") == 0) {
+		return BenchMembers(argc - 1, argv + 1);
+	}
+	if (argc >= 1 && strcmp(argv[0], "lookup") == 0) {
+		return BenchLookup(argc - 1, argv + 1);
+	}
+	printf("usage: minijavac --bench <name> [args...]\n");
+	printf("  parse [nclass nmethod nstmt]           lex and parse a generated program\n");
+	printf("  parse-mt [nthread nclass nmethod nstmt] parse it on nthread threads at once\n");
+	printf("  walk [nclass nmethod nstmt rounds]     walk its AST with ASTNodeVisitor and ASTStaticVisitor\n");
+	printf("  flat [nclass nmethod nstmt rounds]     compare ASTNode and FlatAST memory and walk time\n");
+	printf("  compile [count nclass nmethod nstmt]   compile a small program to files and in memory\n");
+	printf("  emit [nclass nmethod nstmt rounds]     compile with and without listings, inline and on the writer thread\n");
+	printf("  cast [depth width queries]             subtype checks on generated class chains, walked and by table\n");
+	printf("  members [depth nvar nmethod rounds]    class info for one deep chain of classes adding fields and methods\n");
+	printf("  lookup [nvar nmethod queries]          name resolution on one wide class, hash maps, shared tries and flat indices\n");
+	return 1;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+////////// benchmark mode //////////
+
+// synthetic MiniJava program: nclass classes, each with nmethod methods of nstmt statements
+std::string GenerateBenchProgram(int nclass, int nmethod, int nstmt);
+
+// minijavac --bench <name> [args...]
+int RunBenchmark(int argc, char *argv[]);
@@ -12,12 +12,12 @@ bool MethodDecl::operator == (const MethodDecl &r) const
 	return true;
 }
 
-const std::string &VarDeclItem::GetName() const
+Symbol VarDeclItem::GetName() const
 {
 	return this->decl.name;
 }
 
-data_off_t VarDeclList::GetTotalSize()
+data_off_t VarDeclList::GetTotalSize() const
 {
 	data_off_t ret;
 	if (this->empty()) {
@@ -41,29 +41,29 @@ void VarDeclList::Dump(FILE *fp)
 	}
 }
 
-VarDeclListVisitor::VarDeclListVisitor(VarDeclList base) : list(base)
+VarDeclListVisitor::VarDeclListVisitor(CompilationContext &ctx, VarDeclList base) : ctx(ctx), list(base)
 {
 }
 void VarDeclListVisitor::Visit(ASTVarDeclaration *node, int level)
 {
 	if (!list.Append(VarDeclItem {
 		VarDecl {
-			node->GetASTType()->GetTypeInfo(),
-			node->GetASTIdentifier()->id,
+			node->GetASTType().GetTypeInfo(),
+			node->GetASTIdentifier().id,
 		},
 		list.GetTotalSize(),
-		node->GetASTType()->GetTypeSize(),
+		node->GetASTType().GetTypeSize(),
 	})) {
-		MiniJavaC::Instance()->ReportError(node->GetASTIdentifier()->loc, "duplicate variable");
+		ctx.ReportError(node->GetASTIdentifier().loc, "duplicate variable");
 	}
 }
 
-data_off_t MethodDeclList::GetTotalSize()
+data_off_t MethodDeclList::GetTotalSize() const
 {
 	return this->size() * 4;
 }
 
-const std::string &MethodDeclItem::GetName() const
+Symbol MethodDeclItem::GetName() const
 {
 	return this->decl.name;
 }
@@ -78,23 +78,23 @@ void MethodDeclList::Dump(FILE *fp)
 	}
 }
 
-MethodDeclListVisitor::MethodDeclListVisitor(MethodDeclList base, const std::string &clsname) : list(base), clsname(clsname)
+MethodDeclListVisitor::MethodDeclListVisitor(CompilationContext &ctx, MethodDeclList base, Symbol clsname) : ctx(ctx), clsname(clsname), list(base)
 {
 }
 void MethodDeclListVisitor::Visit(ASTMethodDeclaration *node, int level)
 {
-	ErrFlagObj ef;
+	ErrFlagObj ef(ctx);
 
 	MethodDeclItem new_item {
 		MethodDecl {
-			node->GetASTType()->GetTypeInfo(),
-			node->GetASTIdentifier()->id,
-			node->GetASTArgDeclarationList1()->GetVarDeclList(VarDeclList()),
+			node->GetASTType().GetTypeInfo(),
+			node->GetASTIdentifier().id,
+			node->GetASTArgDeclarationList1().GetVarDeclList(ctx, VarDeclList()),
 		},
 		list.GetTotalSize(),
-		node->GetASTVarDeclarationList()->GetVarDeclList(VarDeclList()),
+		node->GetASTVarDeclarationList().GetVarDeclList(ctx, VarDeclList()),
 		clsname,
-		std::dynamic_pointer_cast<ASTMethodDeclaration>(node->GetSharedPtr()),
+		node,
 	};
 
 
@@ -106,24 +106,24 @@ void MethodDeclListVisitor::Visit(ASTMethodDeclaration *node, int level)
 			// override method
 			if (it->decl == new_item.decl) {
 				new_item.off = it->off;
-				*it = new_item;
+				list.Replace(it, new_item);
 			} else {
-				MiniJavaC::Instance()->ReportError(node->GetASTIdentifier()->loc, "different method prototype", true);
+				ctx.ReportError(node->GetASTIdentifier().loc, "different method prototype", true);
 			}
 		} else {
-			MiniJavaC::Instance()->ReportError(node->GetASTIdentifier()->loc, "duplicate method", true);
+			ctx.ReportError(node->GetASTIdentifier().loc, "duplicate method", true);
 		}
 	}
 
 	for (auto &v: list.back().decl.arg) {
 		if (list.back().localvar.Find(v.GetName()) != list.back().localvar.end()) {
-			MiniJavaC::Instance()->ReportError(node->GetASTIdentifier()->loc, v.GetName() + " exists in both local-var and method-arg");
+			ctx.ReportError(node->GetASTIdentifier().loc, v.GetName() + " exists in both local-var and method-arg");
 			break;
 		}
 	}
 }
 
-const std::string &ClassInfoItem::GetName() const
+Symbol ClassInfoItem::GetName() const
 {
 	return name;
 }
@@ -141,31 +141,89 @@ void ClassInfoList::Dump(FILE *fp)
 		item.Dump(fp);
 	}
 }
+void ClassInfoList::BuildHierarchy()
+{
+	// bases come first, so subtree sizes sum up backwards and numbers are handed out forwards
+	const uint32_t NONE = UINT32_MAX;
+	size_t n = size();
+	std::vector<uint32_t> parent(n, NONE), next(n);
+	for (size_t i = 0; i < n; i++) {
+		auto base = Find((*this)[i].base);
+		if (base != end() && (size_t) (base - begin()) < i) {
+			parent[i] = (uint32_t) (base - begin());
+		}
+	}
+	subtree.assign(n, 1);
+	for (size_t i = n; i-- > 0; ) {
+		if (parent[i] != NONE) subtree[parent[i]] += subtree[i];
+	}
+	order.assign(n, 0);
+	uint32_t top = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (parent[i] == NONE) {
+			order[i] = top;
+			top += subtree[i];
+		} else {
+			order[i] = next[parent[i]];
+			next[parent[i]] += subtree[i];
+		}
+		next[i] = order[i] + 1;
+	}
+}
+void ClassInfoList::BuildIndex()
+{
+	// a class's lists start as copies of its base's, which comes first and is indexed already,
+	// so they only index what the class adds, and only its own methods get indices on their variables
+	for (size_t i = 0; i < size(); i++) {
+		auto &cls = (*this)[i];
+		auto base = Find(cls.base);
+		if (base != end() && (size_t) (base - begin()) < i) {
+			cls.var.BuildIndex(&base->var);
+			cls.method.BuildIndex(&base->method);
+		} else {
+			cls.var.BuildIndex();
+			cls.method.BuildIndex();
+		}
+		for (auto &method: cls.method) {
+			if (method.clsname == cls.GetName()) {
+				method.decl.arg.BuildIndex();
+				method.localvar.BuildIndex();
+			}
+		}
+	}
+}
+bool ClassInfoList::IsSubclassOf(size_t cls, size_t base) const
+{
+	return order[cls] - order[base] < subtree[base]; // unsigned, below order[base] wraps around
+}
+ClassInfoVisitor::ClassInfoVisitor(CompilationContext &ctx) : ctx(ctx)
+{
+}
 void ClassInfoVisitor::Visit(ASTClassDeclaration *node, int level)
 {
 	if (!list.Append(ClassInfoItem{
-		node->GetASTIdentifier()->id,
-		node->GetASTVarDeclarationList()->GetVarDeclList(VarDeclList()),
-		node->GetASTMethodDeclarationList()->GetMethodDeclList(MethodDeclList(), node->GetASTIdentifier()->id),
-		std::string(),
+		node->GetASTIdentifier().id,
+		node->GetASTVarDeclarationList().GetVarDeclList(ctx, VarDeclList()),
+		node->GetASTMethodDeclarationList().GetMethodDeclList(ctx, MethodDeclList(), node->GetASTIdentifier().id),
+		Symbol(),
 	})) {
-		MiniJavaC::Instance()->ReportError(node->GetASTIdentifier()->loc, "duplicate class");
+		ctx.ReportError(node->GetASTIdentifier().loc, "duplicate class");
 	}
 }
 void ClassInfoVisitor::Visit(ASTDerivedClassDeclaration *node, int level)
 {
-	auto it = list.Find(node->GetBaseASTIdentifier()->id);
+	auto it = list.Find(node->GetBaseASTIdentifier().id);
 	if (it != list.end()) {
 		if (!list.Append(ClassInfoItem{
-			node->GetASTIdentifier()->id,
-			node->GetASTVarDeclarationList()->GetVarDeclList(it->var),
-			node->GetASTMethodDeclarationList()->GetMethodDeclList(it->method, node->GetASTIdentifier()->id),
+			node->GetASTIdentifier().id,
+			node->GetASTVarDeclarationList().GetVarDeclList(ctx, it->var),
+			node->GetASTMethodDeclarationList().GetMethodDeclList(ctx, it->method, node->GetASTIdentifier().id),
 			it->GetName(),
 		})) {
-			MiniJavaC::Instance()->ReportError(node->GetASTIdentifier()->loc, "duplicate class");
+			ctx.ReportError(node->GetASTIdentifier().loc, "duplicate class");
 		}
 	} else {
-		MiniJavaC::Instance()->ReportError(node->GetBaseASTIdentifier()->loc, "no such class");
+		ctx.ReportError(node->GetBaseASTIdentifier().loc, "no such class");
 	}
 }
 
@@ -309,14 +367,14 @@ data_off_t DataBuffer::GetSymbol(const std::string &symname)
 	}
 	return 0;
 }
-void DataBuffer::ReduceSymbols(const std::vector<DataBuffer *> buffers)
+void DataBuffer::ReduceSymbols(CompilationContext &ctx, const std::vector<DataBuffer *> buffers)
 {
 	std::map<std::string, std::pair<std::list<std::shared_ptr<DataItem> > *, std::list<std::shared_ptr<DataItem> >::iterator > > allsym;
 
 	for (auto &b: buffers) {
 		for (auto &s: b->sym) {
 			if (!allsym.insert(s).second) {
-				MiniJavaC::Instance()->ReportError("duplicate symbol: " + s.first);
+				ctx.ReportError("duplicate symbol: " + s.first);
 			}
 		}
 	}
@@ -329,7 +387,7 @@ void DataBuffer::ReduceSymbols(const std::vector<DataBuffer *> buffers)
 					it->second.first->insert(it->second.second, s.second.first);
 					s.second.second = true;
 				} else {
-					MiniJavaC::Instance()->ReportError("unresolved external symbol: " + s.first);
+					ctx.ReportError("unresolved external symbol: " + s.first);
 				}
 			}
 		}
@@ -394,76 +452,32 @@ bool TypeInfo::operator != (const TypeInfo &r) const
 {
 	return ! operator == (r);
 }
-bool TypeInfo::CanCastTo(const TypeInfo &r) const
+bool TypeInfo::CanCastTo(const TypeInfo &r, ClassInfoList &clsinfo) const
 {
 	if (type != ASTType::VT_CLASS) return false;
 	if (r.type != ASTType::VT_CLASS) return false;
-	std::string curcls = clsname;
-	while (1) {
-		auto &clsinfo = CodeGen::Instance()->clsinfo;
-		if (curcls == r.clsname) return true;
-		if (curcls == "") return false;
-		auto it = clsinfo.Find(curcls);
-		if (it == clsinfo.end()) return false;
-		curcls = it->base;
-	}
+	if (clsname == r.clsname) return true;
+	auto from = clsinfo.Find(clsname), to = clsinfo.Find(r.clsname);
+	if (from == clsinfo.end() || to == clsinfo.end()) return false;
+	return clsinfo.IsSubclassOf(from - clsinfo.begin(), to - clsinfo.begin());
 }
 
-CodeGen::CodeGen()
+CodeGen::CodeGen(CompilationContext &ctx) : ctx(ctx)
 {
 }
-CodeGen *CodeGen::Instance()
-{
-	static CodeGen inst;
-	return &inst;
-}
-
-void CodeGen::AssertTypeEmpty(const yyltype &loc)
-{
-	if (!varstack.empty()) {
-		MiniJavaC::Instance()->ReportError(loc, "internal error: assert failed, stack not empty");
-		return;
-	}
-}
-TypeInfo CodeGen::PopType()
-{
-	TypeInfo r = varstack.back();
-	varstack.pop_back();
-	return r;
-}
-void CodeGen::PopAndCheckType(const yyltype &loc, TypeInfo tinfo)
-{
-	if (varstack.empty()) {
-		MiniJavaC::Instance()->ReportError(loc, "internal error: stack empty");
-		return;
-	}
-	TypeInfo &pinfo = varstack.back();
-	
-	if (tinfo != pinfo && !pinfo.CanCastTo(tinfo)) {
-		std::string msg = "type mismatch: " + pinfo.GetName() + ", expected " + tinfo.GetName();
-		MiniJavaC::Instance()->ReportError(loc, msg);
-	}
-
-	varstack.pop_back();
-}
-
-void CodeGen::PushType(TypeInfo tinfo)
-{
-	varstack.push_back(tinfo);
-}
 
 void CodeGen::Visit(ASTStatement *node, int level)
 {
 	code.AppendItem(DataItem::New()->AddU8({0xCC})->SetComment("ERROR: unhandled statement"));
-	printf("unhandled: %s\n", typeid(*node).name());
-	MiniJavaC::Instance()->ReportError(node->loc, "internal error: unhandled statement");
+	ctx.Log("unhandled: %s\n", typeid(*node).name());
+	ctx.ReportError(node->loc, "internal error: unhandled statement");
 	VisitChildren(node, level);
 }
 void CodeGen::Visit(ASTExpression *node, int level)
 {
 	code.AppendItem(DataItem::New()->AddU8({0xCC})->SetComment("ERROR: unhandled statement"));
-	printf("unhandled: %s\n", typeid(*node).name());
-	MiniJavaC::Instance()->ReportError(node->loc, "internal error: unhandled expression");
+	ctx.Log("unhandled: %s\n", typeid(*node).name());
+	ctx.ReportError(node->loc, "internal error: unhandled expression");
 	VisitChildren(node, level);
 }
 
@@ -473,13 +487,8 @@ void CodeGen::Visit(ASTExpression *node, int level)
 void CodeGen::Visit(ASTArrayAssignStatement *node, int level)
 {
 	GenerateCodeForASTNode(node->GetASTIdentifier());
-	PopAndCheckType(node->GetASTIdentifier()->loc, TypeInfo{ASTType::VT_INTARRAY});
-
 	GenerateCodeForASTNode(node->GetSubscriptASTExpression());
-	PopAndCheckType(node->GetSubscriptASTExpression()->loc, TypeInfo{ASTType::VT_INT});
-
 	GenerateCodeForASTNode(node->GetASTExpression());
-	PopAndCheckType(node->GetASTExpression()->loc, TypeInfo{ASTType::VT_INT});
 
 	code.AppendItem(DataItem::New()->AddU8({0x58})->SetComment("POP EAX"));
 	code.AppendItem(DataItem::New()->AddU8({0x59})->SetComment("POP ECX"));
@@ -490,33 +499,30 @@ void CodeGen::Visit(ASTArrayAssignStatement *node, int level)
 void CodeGen::Visit(ASTAssignStatement *node, int level)
 {
 	GenerateCodeForASTNode(node->GetASTExpression());
-	auto v = GetLocalVar(node->GetASTIdentifier()->id);
-	if (v.second.type != ASTType::VT_UNKNOWN) {
-		PopAndCheckType(node->GetASTIdentifier()->loc, v.second);
-		assert(v.first.second % 4 == 0);
-		for (data_off_t i = 0; i < v.first.second; i += 4) {
-			// pop [ebp+(off+i)]
-			code.AppendItem(DataItem::New()->AddU8({0x8F, 0x85})->AddU32({(uint32_t)(v.first.first + i)})->SetComment("store local-var " + node->GetASTIdentifier()->id));
-		}
-	} else {
-		v = GetMemberVar(node->GetASTIdentifier()->id);
-		if (v.second.type != ASTType::VT_UNKNOWN) {
-			PopAndCheckType(node->GetASTIdentifier()->loc, v.second);
+	ASTIdentifier &ident = node->GetASTIdentifier();
+	switch (ident.declkind) {
+		case ASTIdentifier::DECL_LOCAL:
+		case ASTIdentifier::DECL_ARG:
+			assert(ident.slot_size % 4 == 0);
+			for (data_off_t i = 0; i < ident.slot_size; i += 4) {
+				// pop [ebp+(off+i)]
+				code.AppendItem(DataItem::New()->AddU8({0x8F, 0x85})->AddU32({(uint32_t)(ident.slot_off + i)})->SetComment("store local-var " + ident.id));
+			}
+			break;
+		case ASTIdentifier::DECL_FIELD:
 			LoadThisToEAX();
-			assert(v.first.second % 4 == 0);
-			for (data_off_t i = 0; i < v.first.second; i += 4) {
+			assert(ident.slot_size % 4 == 0);
+			for (data_off_t i = 0; i < ident.slot_size; i += 4) {
 				// pop [eax+(off+i)]
-				code.AppendItem(DataItem::New()->AddU8({0x8F, 0x80})->AddU32({(uint32_t)(v.first.first + i)})->SetComment("store member-var " + node->GetASTIdentifier()->id));
+				code.AppendItem(DataItem::New()->AddU8({0x8F, 0x80})->AddU32({(uint32_t)(ident.slot_off + i)})->SetComment("store member-var " + ident.id));
 			}
-		} else {
-			MiniJavaC::Instance()->ReportError(node->loc, "undeclared identifier " + node->GetASTIdentifier()->id);
-		}
+			break;
+		default: break; // undeclared, TypeCheck reported it
 	}
 }
 void CodeGen::Visit(ASTPrintlnStatement *node, int level)
 {
 	GenerateCodeForASTNode(node->GetASTExpression());
-	PopAndCheckType(node->GetASTExpression()->loc, TypeInfo { ASTType::VT_INT });
 
 	auto fmtstr = data.AppendItem(DataItem::New()->AddString("%d\n"));
 	code.AppendItem(DataItem::New()->AddU8({0x68})->AddRel32(0, RelocInfo::RELOC_ABS32, fmtstr)->SetComment("PUSH fmtstr"));
@@ -530,7 +536,6 @@ void CodeGen::Visit(ASTWhileStatement *node, int level)
 
 	code.AppendItem(beginmarker);
 	GenerateCodeForASTNode(node->GetASTExpression());
-	PopAndCheckType(node->GetASTExpression()->loc, (TypeInfo { ASTType::VT_BOOLEAN }));
 	code.AppendItem(DataItem::New()->AddU8({0x58})->SetComment("POP EAX"));
 	code.AppendItem(DataItem::New()->AddU8({0x85, 0xC0})->SetComment("TEST EAX,EAX"));
 	code.AppendItem(DataItem::New()->AddU8({0x0F, 0x84})->AddRel32(0x6, RelocInfo::RELOC_REL32, endmarker)->SetComment("JZ end-marker"));
@@ -546,7 +551,6 @@ void CodeGen::Visit(ASTIfElseStatement *node, int level)
 	auto elsemarker = DataItem::New();
 
 	GenerateCodeForASTNode(node->GetASTExpression());
-	PopAndCheckType(node->GetASTExpression()->loc, (TypeInfo { ASTType::VT_BOOLEAN }));
 	code.AppendItem(DataItem::New()->AddU8({0x58})->SetComment("POP EAX"));
 	code.AppendItem(DataItem::New()->AddU8({0x85, 0xC0})->SetComment("TEST EAX,EAX"));
 	code.AppendItem(DataItem::New()->AddU8({0x0F, 0x84})->AddRel32(0x6, RelocInfo::RELOC_REL32, elsemarker)->SetComment("JZ else-marker"));
@@ -567,36 +571,32 @@ void CodeGen::Visit(ASTBlockStatement *node, int level)
 // expression
 void CodeGen::Visit(ASTIdentifier *node, int level)
 {
-	auto v = GetLocalVar(node->id);
-	if (v.second.type != ASTType::VT_UNKNOWN) {
-		assert(v.first.second % 4 == 0);
-		for (data_off_t i = v.first.second - 4; i >= 0; i -= 4) {
-			// push [ebp+(off+i)]
-			code.AppendItem(DataItem::New()->AddU8({0xFF, 0xB5})->AddU32({(uint32_t)(v.first.first + i)})->SetComment("load local-var " + node->id));
-		}
-	} else {
-		v = GetMemberVar(node->id);
-		if (v.second.type != ASTType::VT_UNKNOWN) {
+	switch (node->declkind) {
+		case ASTIdentifier::DECL_LOCAL:
+		case ASTIdentifier::DECL_ARG:
+			assert(node->slot_size % 4 == 0);
+			for (data_off_t i = node->slot_size - 4; i >= 0; i -= 4) {
+				// push [ebp+(off+i)]
+				code.AppendItem(DataItem::New()->AddU8({0xFF, 0xB5})->AddU32({(uint32_t)(node->slot_off + i)})->SetComment("load local-var " + node->id));
+			}
+			break;
+		case ASTIdentifier::DECL_FIELD:
 			LoadThisToEAX();
-			assert(v.first.second % 4 == 0);
-			for (data_off_t i = v.first.second - 4; i >= 0; i -= 4) {
+			assert(node->slot_size % 4 == 0);
+			for (data_off_t i = node->slot_size - 4; i >= 0; i -= 4) {
 				// push [eax+(off+i)]
-				code.AppendItem(DataItem::New()->AddU8({0xFF, 0xB0})->AddU32({(uint32_t)(v.first.first + i)})->SetComment("load member-var " + node->id));
+				code.AppendItem(DataItem::New()->AddU8({0xFF, 0xB0})->AddU32({(uint32_t)(node->slot_off + i)})->SetComment("load member-var " + node->id));
 			}
-		} else {
-			MiniJavaC::Instance()->ReportError(node->loc, "undeclared identifier " + node->id);
-		}
+			break;
+		default: break; // undeclared, TypeCheck reported it
 	}
-	PushType(v.second);
 }
 void CodeGen::Visit(ASTBoolean *node, int level)
 {
-	PushType(TypeInfo { ASTType::VT_BOOLEAN });
 	code.AppendItem(DataItem::New()->AddU8({0x6A})->AddU8({(uint8_t)node->val})->SetComment("PUSH ast_boolean"));
 }
 void CodeGen::Visit(ASTNumber *node, int level)
 {
-	PushType(TypeInfo { ASTType::VT_INT });
 	code.AppendItem(DataItem::New()->AddU8({0x68})->AddU32({(uint32_t)node->val})->SetComment("PUSH ast_number"));
 }
 void CodeGen::Visit(ASTBinaryExpression *node, int level)
@@ -604,30 +604,6 @@ void CodeGen::Visit(ASTBinaryExpression *node, int level)
 	GenerateCodeForASTNode(node->GetLeftASTExpression());
 	GenerateCodeForASTNode(node->GetRightASTExpression());
 
-	TypeInfo ltype, rtype, restype; // l/r operand type, result type
-	switch (node->op) {
-		case TOK_LAND:
-			ltype = rtype = restype = TypeInfo { ASTType::VT_BOOLEAN };
-			break;
-		case TOK_LT: // less then
-			ltype = rtype = TypeInfo { ASTType::VT_INT };
-			restype = TypeInfo { ASTType::VT_BOOLEAN };
-			break;
-		case TOK_ADD:
-		case TOK_SUB:
-		case TOK_MUL:
-			ltype = rtype = restype = TypeInfo { ASTType::VT_INT };
-			break;
-		case TOK_LS: // subscript
-			ltype = TypeInfo { ASTType::VT_INTARRAY };
-			rtype = restype = TypeInfo { ASTType::VT_INT };
-
-			break;
-		default: panic();
-	}
-	PopAndCheckType(node->GetRightASTExpression()->loc, rtype);
-	PopAndCheckType(node->GetLeftASTExpression()->loc, ltype);
-
 	switch (node->op) {
 		case TOK_LAND:
 			code.AppendItem(DataItem::New()->AddU8({0x58})->SetComment("POP EAX"));
@@ -661,17 +637,13 @@ void CodeGen::Visit(ASTBinaryExpression *node, int level)
 			break;
 		default: panic();
 	}
-
-	PushType(restype);
 }
 void CodeGen::Visit(ASTUnaryExpression *node, int level)
 {
 	GenerateCodeForASTNode(node->GetASTExpression());
 	switch (node->op) {
 		case TOK_NOT:
-			PopAndCheckType(node->GetASTExpression()->loc, TypeInfo { ASTType::VT_BOOLEAN });
 			code.AppendItem(DataItem::New()->AddU8({0x83, 0x34, 0xE4, 0x01})->SetComment("XOR [ESP],1"));
-			PushType(TypeInfo { ASTType::VT_BOOLEAN });
 			break;
 		case TOK_LP:
 			// nothing to do
@@ -683,73 +655,25 @@ void CodeGen::Visit(ASTUnaryExpression *node, int level)
 void CodeGen::Visit(ASTArrayLengthExpression *node, int level)
 {
 	GenerateCodeForASTNode(node->GetASTExpression());
-	PopAndCheckType(node->GetASTExpression()->loc, TypeInfo { ASTType::VT_INTARRAY });
 	code.AppendItem(DataItem::New()->AddU8({0x58})->SetComment("POP EAX"));
-	PushType(TypeInfo { ASTType::VT_INT });
 }
 
 void CodeGen::Visit(ASTFunctionCallExpression *node, int level)
 {
-	ErrFlagObj ef;
-
-	class MethodArgVisitor : public ASTNodeVisitor {
-	public:
-		std::vector<std::shared_ptr<ASTNode> > arglist;
-		virtual void Visit(ASTExpression *node, int level) override
-		{
-			arglist.push_back(node->GetSharedPtr());
-		}
-	};
-
-	MethodArgVisitor v;
-	node->GetASTArgExpressionList1()->Accept(v);
-	std::reverse(v.arglist.begin(), v.arglist.end());
-
-	for (auto &argexpr: v.arglist) {
-		GenerateCodeForASTNode(argexpr);
+	std::vector<ASTExpression *> arglist = node->GetArgs();
+	for (auto it = arglist.rbegin(); it != arglist.rend(); ++it) {
+		GenerateCodeForASTNode(**it);
 	}
-	
 	GenerateCodeForASTNode(node->GetASTExpression());
-	TypeInfo cls = PopType();
-	VarDeclList *marglist = nullptr;
-	data_off_t vtbloff;
-	TypeInfo rtype;
-
-	if (cls.type == ASTType::VT_CLASS) {
-		auto cit = clsinfo.Find(cls.clsname);
-		if (cit != clsinfo.end()) {
-			auto mit = cit->method.Find(node->GetASTIdentifier()->id);
-			if (mit != cit->method.end()) {
-				marglist = &mit->decl.arg;
-				vtbloff = mit->off;
-				rtype = mit->decl.rettype;
-			} else {
-				MiniJavaC::Instance()->ReportError(node->GetASTIdentifier()->loc, "no such method", true);
-			}
-		} else {
-			MiniJavaC::Instance()->ReportError(node->GetASTExpression()->loc, "no such class", true);
-		}
-	} else {
-		MiniJavaC::Instance()->ReportError(node->GetASTExpression()->loc, "not a class", true);
-	}
 
-	if (marglist && marglist->size() == v.arglist.size()) {
-		for (auto it = marglist->begin(); it != marglist->end(); it++) {	
-			PopAndCheckType((*(v.arglist.rbegin() + (it - marglist->begin())))->loc, it->decl.type);
-		}
+	// TypeCheck reported unknown methods and argument count mismatches
+	ASTIdentifier &ident = node->GetASTIdentifier();
+	if (ident.declkind == ASTIdentifier::DECL_METHOD && ident.method->decl.arg.size() == arglist.size()) {
 		code.AppendItem(DataItem::New()->AddU8({0x8B, 0x04, 0xE4})->SetComment("MOV EAX,[ESP] (eax=this)"));
 		code.AppendItem(DataItem::New()->AddU8({0x8B, 0x00})->SetComment("MOV EAX,[EAX] (eax=vfptr)"));
-		code.AppendItem(DataItem::New()->AddU8({0xFF, 0x90})->AddU32({(uint32_t)vtbloff})->SetComment("CALL [EAX+vtbloff] (eax=vfptr)"));
-		code.AppendItem(DataItem::New()->AddU8({0x81, 0xC4})->AddU32({(uint32_t)((v.arglist.size() + 1) * 4)})->SetComment("ADD ESP,argsize"));
+		code.AppendItem(DataItem::New()->AddU8({0xFF, 0x90})->AddU32({(uint32_t)ident.method->off})->SetComment("CALL [EAX+vtbloff] (eax=vfptr)"));
+		code.AppendItem(DataItem::New()->AddU8({0x81, 0xC4})->AddU32({(uint32_t)((arglist.size() + 1) * 4)})->SetComment("ADD ESP,argsize"));
 		code.AppendItem(DataItem::New()->AddU8({0x50})->SetComment("PUSH EAX"));
-
-		PushType(rtype);
-	} else {
-		for (auto &t: v.arglist) {
-			PopType();
-		}
-		MiniJavaC::Instance()->ReportError(node->GetASTArgExpressionList1()->loc, "arg number mismatch");
-		PushType(TypeInfo { ASTType::VT_UNKNOWN });
 	}
 }
 void CodeGen::Visit(ASTThisExpression *node, int level)
@@ -757,41 +681,29 @@ void CodeGen::Visit(ASTThisExpression *node, int level)
 	if (cur_cls) {
 		LoadThisToEAX();
 		code.AppendItem(DataItem::New()->AddU8({0x50})->SetComment("PUSH EAX"));
-		PushType(TypeInfo { ASTType::VT_CLASS, cur_cls->name });
-	} else {
-		MiniJavaC::Instance()->ReportError(node->loc, "invalid use of this");
-		PushType(TypeInfo { ASTType::VT_UNKNOWN });
 	}
 }
 void CodeGen::Visit(ASTNewIntArrayExpression *node, int level)
 {
 	GenerateCodeForASTNode(node->GetASTExpression());
-	PopAndCheckType(node->GetASTExpression()->loc, TypeInfo { ASTType::VT_INT });
 	code.AppendItem(DataItem::New()->AddU8({0x6A, 0x04})->SetComment("PUSH 4"));
 	code.AppendItem(DataItem::New()->AddU8({0xFF, 0x74, 0xE4, 0x04})->SetComment("PUSH [ESP+4]"));
 	code.AppendItem(DataItem::New()->AddU8({0xE8})->AddRel32(0x5, RelocInfo::RELOC_REL32, code.NewExternalSymbol("IMP$msvcrt.calloc"))->SetComment("CALL calloc"));
 	code.AppendItem(DataItem::New()->AddU8({0x83, 0xC4, 0x08})->SetComment("ADD ESP,8"));
 	code.AppendItem(DataItem::New()->AddU8({0x50})->SetComment("PUSH EAX"));
-	PushType(TypeInfo { ASTType::VT_INTARRAY });
 }
 void CodeGen::Visit(ASTNewExpression *node, int level)
 {
-	auto clsname = node->GetASTIdentifier()->id;
-	auto it = clsinfo.Find(clsname);
-	if (it != clsinfo.end()) {
-		data_off_t clssize = it->var.GetTotalSize() + 4;
+	ASTIdentifier &ident = node->GetASTIdentifier();
+	if (ident.declkind == ASTIdentifier::DECL_CLASS) {
+		data_off_t clssize = ident.cls->var.GetTotalSize() + 4;
 		
 		code.AppendItem(DataItem::New()->AddU8({0x68})->AddU32({(uint32_t)clssize})->SetComment("PUSH clssize"));
 		code.AppendItem(DataItem::New()->AddU8({0x6A, 0x01})->SetComment("PUSH 1"));
 		code.AppendItem(DataItem::New()->AddU8({0xE8})->AddRel32(0x5, RelocInfo::RELOC_REL32, code.NewExternalSymbol("IMP$msvcrt.calloc"))->SetComment("CALL calloc"));
 		code.AppendItem(DataItem::New()->AddU8({0x83, 0xC4, 0x08})->SetComment("ADD ESP,8"));
 		code.AppendItem(DataItem::New()->AddU8({0x50})->SetComment("PUSH EAX"));
-		code.AppendItem(DataItem::New()->AddU8({0xC7, 0x00})->AddRel32(0, RelocInfo::RELOC_ABS32, code.NewExternalSymbol(clsname + ".$vfptr"))->SetComment("MOV [EAX],vfptr"));
-	
-		PushType(TypeInfo { ASTType::VT_CLASS, clsname });
-	} else {
-		MiniJavaC::Instance()->ReportError(node->GetASTIdentifier()->loc, "undeclared class " + clsname);
-		PushType(TypeInfo { ASTType::VT_UNKNOWN });
+		code.AppendItem(DataItem::New()->AddU8({0xC7, 0x00})->AddRel32(0, RelocInfo::RELOC_ABS32, code.NewExternalSymbol(ident.id + ".$vfptr"))->SetComment("MOV [EAX],vfptr"));
 	}
 }
 
@@ -801,50 +713,21 @@ void CodeGen::LoadThisToEAX()
 	code.AppendItem(DataItem::New()->AddU8({0x8B, 0x45, 0x08})->SetComment("MOV EAX,[EBP+8] (load this)"));
 }
 
-std::pair<std::pair<data_off_t, data_off_t>, TypeInfo> CodeGen::GetLocalVar(const std::string &name)
-{	
-	if (cur_cls && cur_method) {
-		auto lvar = cur_method->localvar.Find(name);
-		if (lvar != cur_method->localvar.end()) {
-			return std::make_pair(std::make_pair(-cur_method->localvar.GetTotalSize() + lvar->off, lvar->size), lvar->decl.type);
-		}
-
-		auto avar = cur_method->decl.arg.Find(name);
-		if (avar != cur_method->decl.arg.end()) {
-			return std::make_pair(std::make_pair(0xC + avar->off, avar->size), avar->decl.type);
-		}
-	}
-	return std::make_pair(std::make_pair(0, 0), TypeInfo {ASTType::VT_UNKNOWN});
-}
-std::pair<std::pair<data_off_t, data_off_t>, TypeInfo> CodeGen::GetMemberVar(const std::string &name)
-{
-	if (cur_cls && cur_method) {
-		auto mvar = cur_cls->var.Find(name);
-		if (mvar != cur_cls->var.end()) {
-			return std::make_pair(std::make_pair(0x4 + mvar->off, mvar->size), mvar->decl.type);
-		}
-	}
-	return std::make_pair(std::make_pair(0, 0), TypeInfo {ASTType::VT_UNKNOWN});
-}
-
-void CodeGen::GenerateCodeForASTNode(std::shared_ptr<ASTNode> node)
+void CodeGen::GenerateCodeForASTNode(ASTNode &node)
 {
-	node->ASTNode::Accept(*this);
+	Dispatch(&node);
 }
-void CodeGen::GenerateCodeForMainMethod(std::shared_ptr<ASTMainClass> maincls)
+void CodeGen::GenerateCodeForMainMethod(ASTMainClass &maincls)
 {
 	cur_cls = nullptr;
-	cur_method = nullptr;
 	code.ProvideSymbol("$ENTRY");
-	GenerateCodeForASTNode(maincls->GetASTStatement());
+	GenerateCodeForASTNode(maincls.GetASTStatement());
 	code.AppendItem(DataItem::New()->AddU8({0x6A, 0x00})->SetComment("PUSH 0"));
 	code.AppendItem(DataItem::New()->AddU8({0xE8})->AddRel32(0x5, RelocInfo::RELOC_REL32, code.NewExternalSymbol("IMP$msvcrt.exit"))->SetComment("CALL exit"));
-	AssertTypeEmpty(maincls->GetASTStatement()->loc);
 }
-void CodeGen::GenerateCodeForClassMethod(ClassInfoItem &cls, MethodDeclItem &method)
+void CodeGen::GenerateCodeForClassMethod(ClassInfoItem &cls, const MethodDeclItem &method)
 {
 	cur_cls = &cls;
-	cur_method = &method;
 	
 	code.ProvideSymbol(cls.GetName() + "." + method.GetName());
 
@@ -861,12 +744,10 @@ void CodeGen::GenerateCodeForClassMethod(ClassInfoItem &cls, MethodDeclItem &met
 
 
 	GenerateCodeForASTNode(method.ptr->GetASTExpression());
-	PopAndCheckType(method.ptr->GetASTExpression()->loc, method.decl.rettype);
 	code.AppendItem(DataItem::New()->AddU8({0x58})->SetComment("POP EAX"));
 	
 	code.AppendItem(DataItem::New()->AddU8({0xC9})->SetComment("LEAVE"));
 	code.AppendItem(DataItem::New()->AddU8({0xC3})->SetComment("RETN"));
-	AssertTypeEmpty(method.ptr->GetASTExpression()->loc);
 }
 void CodeGen::GenerateVtblForClass(ClassInfoItem &cls)
 {
@@ -940,13 +821,10 @@ void CodeGen::MakeIAT()
 		rodata.AppendItem(DataItem::New()->AddString((dllname + ".dll").c_str()));
 	}
 }
-void CodeGen::MakeEXE()
+void CodeGen::MakeImage()
 {
-	FILE *fp = fopen("out.exe", "wb");
-
-	
 	// dos header and dos stub
-	fwrite(
+	static const char dosstub[] =
 		"\x4D\x5A\x90\x00\x03\x00\x00\x00\x04\x00\x00\x00\xFF\xFF\x00\x00"
 		"\xB8\x00\x00\x00\x00\x00\x00\x00\x40\x00\x00\x00\x00\x00\x00\x00"
 		"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
@@ -954,8 +832,7 @@ void CodeGen::MakeEXE()
 		"\x0E\x1F\xBA\x0E\x00\xB4\x09\xCD\x21\xB8\x01\x4C\xCD\x21\x54\x68"
 		"\x69\x73\x20\x70\x72\x6F\x67\x72\x61\x6D\x20\x63\x61\x6E\x6E\x6F"
 		"\x74\x20\x62\x65\x20\x72\x75\x6E\x20\x69\x6E\x20\x44\x4F\x53\x20"
-		"\x6D\x6F\x64\x65\x2E\x0D\x0D\x0A\x24\x00\x00\x00\x00\x00\x00\x00",
-		1, 0x80, fp);
+		"\x6D\x6F\x64\x65\x2E\x0D\x0D\x0A\x24\x00\x00\x00\x00\x00\x00\x00";
 
 	
 	IMAGE_NT_HEADERS nthdr; memset(&nthdr, 0, sizeof(nthdr));
@@ -1000,7 +877,13 @@ void CodeGen::MakeEXE()
 	ppedirectory[IMAGE_DIRECTORY_ENTRY_IAT].VirtualAddress = ToRVA(GetSymbol("$IAT"));
 	ppedirectory[IMAGE_DIRECTORY_ENTRY_IAT].Size = GetSymbol("$IAT.END") - GetSymbol("$IAT");
 
-	fwrite(&nthdr, sizeof(nthdr), 1, fp);
+	// the file is laid out exactly like the loaded image, zero-filled up to SizeOfImage
+	image.assign(popthdr->SizeOfImage, 0);
+	uint8_t *p = image.data();
+	memcpy(p, dosstub, 0x80);
+	p += 0x80;
+	memcpy(p, &nthdr, sizeof(nthdr));
+	p += sizeof(nthdr);
 
 
 	std::vector<DataBuffer *> sections{&code, &rodata, &data};
@@ -1019,20 +902,23 @@ void CodeGen::MakeEXE()
         shdr.PointerToRawData = ToRVA(seg->base_addr);
         shdr.Characteristics = shdr_flags[i];
 
-		fwrite(&shdr, sizeof(shdr), 1, fp);
+		memcpy(p, &shdr, sizeof(shdr));
+		p += sizeof(shdr);
 	}
 
-	fseek(fp, popthdr->SizeOfImage - 1, SEEK_SET);
-	fputc(0, fp);
-
 	std::vector<uint8_t> segdata;
 	for (auto &seg: sections) {
 		segdata = seg->GetContent();
-		fseek(fp, ToRVA(seg->base_addr), SEEK_SET);
-		fwrite(segdata.data(), 1, segdata.size(), fp);
+		memcpy(image.data() + ToRVA(seg->base_addr), segdata.data(), segdata.size());
 	}
-
-	fclose(fp);
+}
+bool CodeGen::WriteEXE(const char *exefile)
+{
+	FILE *fp = exefile ? fopen(exefile, "wb") : stdout;
+	if (!fp) return false;
+	bool ok = fwrite(image.data(), 1, image.size(), fp) == image.size();
+	if (exefile) fclose(fp); else fflush(fp);
+	return ok;
 }
 data_off_t CodeGen::ToRVA(data_off_t addr)
 {
@@ -1055,35 +941,38 @@ void CodeGen::Link()
 
 	std::vector<DataBuffer *> sections{&code, &rodata, &data};
 
-	printf(" [*] Processing symbols ...\n");
-	DataBuffer::ReduceSymbols(sections);
+	ctx.Log(" [*] Processing symbols ...\n");
+	DataBuffer::ReduceSymbols(ctx, sections);
 
-	printf(" [*] Calculating address ...\n");
+	ctx.Log(" [*] Calculating address ...\n");
 	for (auto &sect: sections) {
 		base = sect->CalcOffset(base);
 		base = ROUNDUP(base, PE_SECTIONALIGN);
 	}
 
-	printf(" [*] Relocating ...\n");
+	ctx.Log(" [*] Relocating ...\n");
 	for (auto &sect: sections) {
 		sect->DoRelocate();
 	}
 
-	printf(" [*] Making EXE ...\n");
-	MakeEXE();
+	ctx.Log(" [*] Making EXE ...\n");
+	MakeImage();
 }
 
-void CodeGen::DumpVars(const char *outfile)
+bool CodeGen::DumpVars(const char *outfile)
 {
 	FILE *fp;
 	if (outfile) fp = fopen(outfile, "w"); else fp = stdout;
+	if (!fp) return false;
 	clsinfo.Dump(fp);
 	if (outfile) fclose(fp);
+	return true;
 }
-void CodeGen::DumpSections(const char *outfile)
+bool CodeGen::DumpSections(const char *outfile)
 {
 	FILE *fp;
 	if (outfile) fp = fopen(outfile, "w"); else fp = stdout;
+	if (!fp) return false;
 	fprintf(fp, ".code:\n");
 	code.Dump(fp);
 	fprintf(fp, ".rodata:\n");
@@ -1091,38 +980,55 @@ void CodeGen::DumpSections(const char *outfile)
 	fprintf(fp, ".data:\n");
 	data.Dump(fp);
 	if (outfile) fclose(fp);
+	return true;
+}
+void CodeGen::SetClassInfoList(ClassInfoList &&list)
+{
+	clsinfo = std::move(list);
+	clsinfo_ready = true;
 }
-void CodeGen::GenerateCode()
+void CodeGen::GenerateCode(bool link)
 {
-	printf("[*] Generating type information ...\n");
-	clsinfo = MiniJavaC::Instance()->goal->GetClassInfoList();
-	//clsinfo.Dump();
+	if (!clsinfo_ready) {
+		ctx.Log("[*] Generating type information ...\n");
+		clsinfo = ctx.goal->GetClassInfoList(ctx);
+		//clsinfo.Dump();
+	}
+	clsinfo.BuildHierarchy();
+	clsinfo.BuildIndex();
 
-	printf("[*] Generating code ...\n");
+	// code generation reads the types and declarations it stores on the AST, ASTCache restores them
+	if (!clsinfo_ready) {
+		TypeCheck(ctx, clsinfo).CheckProgram(*ctx.goal);
+	}
+
+	ctx.Log("[*] Generating code ...\n");
 
-	printf(" [*] Generating code for main() ...\n");
-	GenerateCodeForMainMethod(MiniJavaC::Instance()->goal->GetASTMainClass());
+	ctx.Log(" [*] Generating code for main() ...\n");
+	GenerateCodeForMainMethod(ctx.goal->GetASTMainClass());
 
 	for (auto &cls: clsinfo) {
-		printf(" [*] Generating code for class %s ...\n", cls.GetName().c_str());
+		ctx.Log(" [*] Generating code for class %s ...\n", cls.GetName().c_str());
 		for (auto &method: cls.method) {
 			if (method.clsname == cls.GetName()) {
-				printf("  [*] Generating code for %s::%s() ...\n", cls.GetName().c_str(), method.GetName().c_str());
+				ctx.Log("  [*] Generating code for %s::%s() ...\n", cls.GetName().c_str(), method.GetName().c_str());
 				GenerateCodeForClassMethod(cls, method);
 			}
 		}
 	}
 
 	for (auto &cls: clsinfo) {
-		printf(" [*] Generating virtual function table for class %s ...\n", cls.GetName().c_str());
+		ctx.Log(" [*] Generating virtual function table for class %s ...\n", cls.GetName().c_str());
 		GenerateVtblForClass(cls);
 	}
 
-	printf("[*] Adding DLL import table ...\n");
+	if (!link) return;
+
+	ctx.Log("[*] Adding DLL import table ...\n");
 	AddImportEntry("msvcrt", {"printf", "calloc", "exit"});
 	MakeIAT();
 
 
-	printf("[*] Linking ...\n");
+	ctx.Log("[*] Linking ...\n");
 	Link();
 }
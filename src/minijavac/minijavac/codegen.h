@@ -5,39 +5,37 @@
 
 ////////// CodeGen Visitor //////////
 
+// vector with a NameIndex on the item names
 template<class T>
 class NameIndexedList : public std::vector<T> {
-private:
-	std::map<std::string, size_t> listindex;
+	typedef typename std::vector<T>::iterator iterator;
+	NameIndex index;
 public:
 	bool Append(const T &item)
 	{
-		if (listindex.insert(std::make_pair(item.GetName(), std::vector<T>::size())).second) {
-			std::vector<T>::push_back(item);
-			return true;
-		} else {
-			return false;
-		}
+		Symbol name = item.GetName();
+		if (Find(name) != this->end()) return false;
+		index.Insert(name, this->size());
+		this->push_back(item);
+		return true;
 	}
-	std::vector<T>::iterator Find(const std::string &name)
+	iterator Find(Symbol name)
 	{
-		auto it = listindex.find(name);
-		if (it == listindex.end()) {
-			return std::vector<T>::end();
-		} else {
-			return std::vector<T>::begin() + it->second;
-		}
+		size_t pos;
+		return index.Find(name, pos) ? this->begin() + pos : this->end();
 	}
 };
 
+class ClassInfoList;
+
 class TypeInfo {
 public:
 	ASTType::VarType type = ASTType::VT_UNKNOWN;
-	std::string clsname;
+	Symbol clsname;
 public:
 	bool operator == (const TypeInfo &r) const;
 	bool operator != (const TypeInfo &r) const;
-	bool CanCastTo(const TypeInfo &r) const;
+	bool CanCastTo(const TypeInfo &r, ClassInfoList &clsinfo) const;
 	std::string GetName();
 };
 
@@ -47,7 +45,7 @@ public:
 class VarDecl {
 public:
 	TypeInfo type;
-	std::string name;
+	Symbol name;
 };
 
 class VarDeclItem {
@@ -56,13 +54,13 @@ public:
 	data_off_t off;
 	data_off_t size;
 public:
-	const std::string &GetName() const;
+	Symbol GetName() const;
 };
 
-class VarDeclList : public NameIndexedList<VarDeclItem> {
+class VarDeclList : public SharedNameIndexedList<VarDeclItem> {
 public:
 	void Dump(FILE *fp);
-	data_off_t GetTotalSize();
+	data_off_t GetTotalSize() const;
 };
 
 // MethodDecl
@@ -70,7 +68,7 @@ public:
 class MethodDecl {
 public:
 	TypeInfo rettype;
-	std::string name;
+	Symbol name;
 	VarDeclList arg;
 	bool operator == (const MethodDecl &r) const;
 };
@@ -80,16 +78,16 @@ public:
 	MethodDecl decl;
 	data_off_t off;
 	VarDeclList localvar;
-	std::string clsname;
-	std::shared_ptr<ASTMethodDeclaration> ptr;
+	Symbol clsname;
+	ASTMethodDeclaration *ptr;
 public:
-	const std::string &GetName() const;
+	Symbol GetName() const;
 };
 
-class MethodDeclList : public NameIndexedList<MethodDeclItem> {
+class MethodDeclList : public SharedNameIndexedList<MethodDeclItem> {
 public:
 	void Dump(FILE *fp);
-	data_off_t GetTotalSize();
+	data_off_t GetTotalSize() const;
 };
 
 
@@ -97,42 +95,55 @@ public:
 
 class ClassInfoItem {
 public:
-	std::string name;
+	Symbol name;
 	VarDeclList var;
 	MethodDeclList method;
-	std::string base;
+	Symbol base;
 public:
-	const std::string &GetName() const;
+	Symbol GetName() const;
 	void Dump(FILE *fp);
 };
 
 class ClassInfoList : public NameIndexedList<ClassInfoItem> {
+	// the classes numbered in preorder of the inheritance forest,
+	// the subclasses of class i are numbered order[i] .. order[i] + subtree[i] - 1
+	std::vector<uint32_t> order, subtree;
 public:
 	void Dump(FILE *fp);
+	void BuildHierarchy(); // once all classes are in, a base class always comes before its derived classes
+	void BuildIndex(); // flat name indices on the member and method lists and on the variables of each class's own methods, once all classes are in
+	bool IsSubclassOf(size_t cls, size_t base) const; // indices into the list, a class is its own subclass
 };
 
 // Visitor
 
-class VarDeclListVisitor : public ASTNodeVisitor {
+class VarDeclListVisitor : public ASTStaticVisitor<VarDeclListVisitor> {
+	CompilationContext &ctx;
 public:
-	VarDeclListVisitor(VarDeclList base);
+	using ASTStaticVisitor<VarDeclListVisitor>::Visit;
+	VarDeclListVisitor(CompilationContext &ctx, VarDeclList base);
 	VarDeclList list;
-	virtual void Visit(ASTVarDeclaration *node, int level) override;
+	void Visit(ASTVarDeclaration *node, int level);
 };
 
-class MethodDeclListVisitor : public ASTNodeVisitor {
-	std::string clsname;
+class MethodDeclListVisitor : public ASTStaticVisitor<MethodDeclListVisitor> {
+	CompilationContext &ctx;
+	Symbol clsname;
 public:
-	MethodDeclListVisitor(MethodDeclList base, const std::string &clsname);
+	using ASTStaticVisitor<MethodDeclListVisitor>::Visit;
+	MethodDeclListVisitor(CompilationContext &ctx, MethodDeclList base, Symbol clsname);
 	MethodDeclList list;
-	virtual void Visit(ASTMethodDeclaration *node, int level) override;
+	void Visit(ASTMethodDeclaration *node, int level);
 };
 
-class ClassInfoVisitor : public ASTNodeVisitor {
+class ClassInfoVisitor : public ASTStaticVisitor<ClassInfoVisitor> {
+	CompilationContext &ctx;
 public:
+	using ASTStaticVisitor<ClassInfoVisitor>::Visit;
+	ClassInfoVisitor(CompilationContext &ctx);
 	ClassInfoList list;
-	virtual void Visit(ASTClassDeclaration *node, int level) override;
-	virtual void Visit(ASTDerivedClassDeclaration *node, int level) override;
+	void Visit(ASTClassDeclaration *node, int level);
+	void Visit(ASTDerivedClassDeclaration *node, int level);
 };
 
 
@@ -195,7 +206,7 @@ public:
 	void DoRelocate();
 	void ProvideSymbol(const std::string &name);
 	void Dump(FILE *fp);
-	static void ReduceSymbols(const std::vector<DataBuffer *> buffers);
+	static void ReduceSymbols(CompilationContext &ctx, const std::vector<DataBuffer *> buffers);
 	data_off_t GetSymbol(const std::string &symname);
 	std::vector<uint8_t> GetContent();
 };
@@ -205,50 +216,35 @@ public:
 ////////// CodeGen //////////
 
 
-class CodeGen : public ASTNodeVisitor {
+class CodeGen : public ASTStaticVisitor<CodeGen> {
 	static const unsigned PE_TOTAL_SECTIONS = 3;
 	static const unsigned PE_IMAGEBASE = 0x00400000;
 	static const unsigned PE_SECTIONALIGN = 0x1000;
 	static const unsigned PE_CODEBASE = 0x1000;
 	static const unsigned PE_FILEALIGN = 0x1000;
 private:
-	std::vector<TypeInfo> varstack;
+	CompilationContext &ctx;
 	ClassInfoItem *cur_cls;
-	MethodDeclItem *cur_method;
 	DataBuffer code, rodata, data;
 public:
 	ClassInfoList clsinfo;
+	bool clsinfo_ready = false; // set when clsinfo comes from ASTCache, the AST is type checked then too
+	std::vector<uint8_t> image; // the linked PE file, made by GenerateCode()
 private:
-	void AssertTypeEmpty(const yyltype &loc);
-	TypeInfo PopType();
-	void PopAndCheckType(const yyltype &loc, TypeInfo tinfo);
-	void PushType(TypeInfo tinfo);
-
 	void LoadThisToEAX();
 
-	// get local-var info (arg and stack var)
-	// return < <bp-offset, size>, type>
-	// return < <0,0>, VT_UNKNOWN > if not found
-	std::pair<std::pair<data_off_t, data_off_t>, TypeInfo> GetLocalVar(const std::string &name);
-
-	// get member-var info
-	// return < <this-offset, size>, type>
-	// return < <0,0>, VT_UNKNOWN > if not found
-	std::pair<std::pair<data_off_t, data_off_t>, TypeInfo> GetMemberVar(const std::string &name);
-
 	// dllinfo
 	std::vector<std::pair<std::string, std::vector<std::string> > > dllinfo; // <dllname, funclist>
 
-	CodeGen();
-	void GenerateCodeForASTNode(std::shared_ptr<ASTNode> node);
-	void GenerateCodeForMainMethod(std::shared_ptr<ASTMainClass> maincls);
-	void GenerateCodeForClassMethod(ClassInfoItem &cls, MethodDeclItem &method);
+	void GenerateCodeForASTNode(ASTNode &node);
+	void GenerateCodeForMainMethod(ASTMainClass &maincls);
+	void GenerateCodeForClassMethod(ClassInfoItem &cls, const MethodDeclItem &method);
 
 	void GenerateVtblForClass(ClassInfoItem &cls);
 
 	void MakeIAT();
 	void AddImportEntry(const std::string &dllname, const std::vector<std::string> &funclist);
-	void MakeEXE();
+	void MakeImage();
 	
 	data_off_t GetSymbol(const std::string &sym);
 	
@@ -256,32 +252,35 @@ private:
 	void Link();
 
 public:
-	virtual void Visit(ASTStatement *node, int level) override;
-	virtual void Visit(ASTExpression *node, int level) override;
+	using ASTStaticVisitor<CodeGen>::Visit;
+	void Visit(ASTStatement *node, int level);
+	void Visit(ASTExpression *node, int level);
 
 	// statment
-	virtual void Visit(ASTArrayAssignStatement *node, int level);
-	virtual void Visit(ASTAssignStatement *node, int level);
-	virtual void Visit(ASTPrintlnStatement *node, int level);
-	virtual void Visit(ASTWhileStatement *node, int level);
-	virtual void Visit(ASTIfElseStatement *node, int level);
-	virtual void Visit(ASTBlockStatement *node, int level);
+	void Visit(ASTArrayAssignStatement *node, int level);
+	void Visit(ASTAssignStatement *node, int level);
+	void Visit(ASTPrintlnStatement *node, int level);
+	void Visit(ASTWhileStatement *node, int level);
+	void Visit(ASTIfElseStatement *node, int level);
+	void Visit(ASTBlockStatement *node, int level);
 
 	// expression
-	virtual void Visit(ASTIdentifier *node, int level);
-	virtual void Visit(ASTBoolean *node, int level);
-	virtual void Visit(ASTNumber *node, int level);
-	virtual void Visit(ASTBinaryExpression *node, int level);
-	virtual void Visit(ASTUnaryExpression *node, int level);
-	virtual void Visit(ASTArrayLengthExpression *node, int level);
-	virtual void Visit(ASTFunctionCallExpression *node, int level);
-	virtual void Visit(ASTThisExpression *node, int level);
-	virtual void Visit(ASTNewIntArrayExpression *node, int level);
-	virtual void Visit(ASTNewExpression *node, int level);
+	void Visit(ASTIdentifier *node, int level);
+	void Visit(ASTBoolean *node, int level);
+	void Visit(ASTNumber *node, int level);
+	void Visit(ASTBinaryExpression *node, int level);
+	void Visit(ASTUnaryExpression *node, int level);
+	void Visit(ASTArrayLengthExpression *node, int level);
+	void Visit(ASTFunctionCallExpression *node, int level);
+	void Visit(ASTThisExpression *node, int level);
+	void Visit(ASTNewIntArrayExpression *node, int level);
+	void Visit(ASTNewExpression *node, int level);
 public:
-	static CodeGen *Instance();
-	void GenerateCode();
-	void DumpSections(const char *outfile);
-	void DumpVars(const char *outfile);
+	CodeGen(CompilationContext &ctx);
+	void SetClassInfoList(ClassInfoList &&list);
+	void GenerateCode(bool link = true);
+	bool WriteEXE(const char *exefile);
+	bool DumpSections(const char *outfile);
+	bool DumpVars(const char *outfile);
 	static data_off_t ToRVA(data_off_t addr);
 };
@@ -10,9 +10,14 @@
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <psapi.h>
+#include <io.h>
+#include <fcntl.h>
 
 
+#include <cstddef>
 #include <cstdio>
+#include <cstdarg>
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
@@ -23,18 +28,39 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <string>
 #include <list>
+#include <deque>
+#include <unordered_map>
 #include <memory>
+#include <bitset>
 #include <functional>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 
 
 typedef int32_t data_off_t;
 #define panic() abort()
 
+#include "symbol.h"
 #include "minijavac.h"
+#include "writer.h"
 #include "astnode.h"
+#include "flatast.h"
+#include "sharedlist.h"
 #include "codegen.h"
+#include "typecheck.h"
+#include "astcache.h"
+#include "bench.h"
+#include "selftest.h"
+#include "batch.h"
+#include "serverproto.h"
+#include "server.h"
+#include "library.h"
 
 static inline data_off_t ROUNDUP(data_off_t a, data_off_t b)
 {
@@ -0,0 +1,258 @@
+#include "common.h"
+#include "minijavac.tab.h"
+
+//////////////// FlatAST ////////////////
+
+uint32_t FlatAST::GetNodeData(ASTNode *node)
+{
+	switch (node->kind) {
+		case ASTNodeKind::ASTIdentifier:        return GetSymbolIndex(node->As<ASTIdentifier>().id);
+		case ASTNodeKind::ASTNumber:            return (uint32_t) node->As<ASTNumber>().val;
+		case ASTNodeKind::ASTBoolean:           return (uint32_t) node->As<ASTBoolean>().val;
+		case ASTNodeKind::ASTBinaryExpression:  return (uint32_t) node->As<ASTBinaryExpression>().op;
+		case ASTNodeKind::ASTUnaryExpression:   return (uint32_t) node->As<ASTUnaryExpression>().op;
+		case ASTNodeKind::ASTType:              return (uint32_t) node->As<ASTType>().type;
+		default:                                return 0;
+	}
+}
+
+uint32_t FlatAST::GetSymbolIndex(Symbol sym)
+{
+	auto it = symbol_index.insert(std::make_pair(sym, (uint32_t) symbols.size()));
+	if (it.second) {
+		symbols.push_back(sym);
+	}
+	return it.first->second;
+}
+
+void FlatAST::Build(ASTNode *root, std::vector<ASTNode *> *order, size_t nodecount)
+{
+	Clear();
+	if (!root) return;
+
+	size_t n = nodecount;
+	own_kind.reserve(n);
+	own_loc.reserve(n);
+	own_first.reserve(n + 1);
+	own_data.reserve(n);
+
+	// the node list doubles as the breadth-first queue, a node's id is its position
+	std::vector<ASTNode *> local_order;
+	if (!order) order = &local_order;
+	order->clear();
+	order->reserve(n);
+	order->push_back(root);
+	for (size_t i = 0; i < order->size(); i++) {
+		ASTNode *node = (*order)[i];
+		own_kind.push_back(node->kind);
+		own_loc.push_back(node->loc);
+		own_first.push_back((NodeId) order->size());
+		own_data.push_back(GetNodeData(node));
+		order->insert(order->end(), node->ch.begin(), node->ch.end());
+	}
+	own_first.push_back((NodeId) order->size());
+
+	count = own_kind.size();
+	kind = own_kind.data();
+	loc = own_loc.data();
+	first = own_first.data();
+	data = own_data.data();
+}
+
+void FlatAST::Attach(size_t count, const ASTNodeKind *kind, const yyltype *loc, const NodeId *first, const uint32_t *data, std::vector<Symbol> symbols)
+{
+	Clear();
+	this->count = count;
+	this->kind = kind;
+	this->loc = loc;
+	this->first = first;
+	this->data = data;
+	this->symbols = std::move(symbols);
+}
+
+// the children of node are exactly of the classes T, in order
+template <class... T>
+static bool HasChildren(FlatASTNode<ASTNode> node)
+{
+	if (node.GetChildCount() != sizeof...(T)) return false;
+	uint32_t i = 0;
+	const bool match[] = { true, node.Child<ASTNode>(i++).Is<T>()... };
+	return std::all_of(std::begin(match), std::end(match), [](bool b) { return b; });
+}
+// any number of children, each of class T or U
+template <class T, class U = T>
+static bool HasChildList(FlatASTNode<ASTNode> node)
+{
+	for (uint32_t i = 0; i < node.GetChildCount(); i++) {
+		FlatASTNode<ASTNode> ch = node.Child<ASTNode>(i);
+		if (!ch.Is<T>() && !ch.Is<U>()) return false;
+	}
+	return true;
+}
+
+// true if node has the children and data the grammar in minijavac.y gives its kind,
+// the kinds of the children are checked, which together with the kind of the root checks the whole tree
+static bool IsValidFlatNode(FlatASTNode<ASTNode> node, uint32_t data)
+{
+	switch (node.GetKind()) {
+		case ASTNodeKind::ASTIdentifier:
+		case ASTNodeKind::ASTNumber:
+		case ASTNodeKind::ASTBoolean:
+		case ASTNodeKind::ASTThisExpression:
+			return HasChildren<>(node);
+		case ASTNodeKind::ASTBinaryExpression:
+			return HasChildren<ASTExpression, ASTExpression>(node)
+				&& (data == TOK_LAND || data == TOK_LT || data == TOK_ADD || data == TOK_SUB || data == TOK_MUL || data == TOK_LS);
+		case ASTNodeKind::ASTUnaryExpression:
+			return HasChildren<ASTExpression>(node) && (data == TOK_NOT || data == TOK_LP);
+		case ASTNodeKind::ASTArrayLengthExpression:
+		case ASTNodeKind::ASTNewIntArrayExpression:
+		case ASTNodeKind::ASTPrintlnStatement:
+			return HasChildren<ASTExpression>(node);
+		case ASTNodeKind::ASTFunctionCallExpression:
+			return HasChildren<ASTExpression, ASTIdentifier, ASTArgExpressionList1>(node);
+		case ASTNodeKind::ASTNewExpression:
+			return HasChildren<ASTIdentifier>(node);
+		case ASTNodeKind::ASTArgExpressionList1:
+			return HasChildren<>(node) || HasChildren<ASTExpression, ASTArgExpressionList2>(node);
+		case ASTNodeKind::ASTArgExpressionList2:
+			return HasChildList<ASTExpression>(node);
+		case ASTNodeKind::ASTArrayAssignStatement:
+			return HasChildren<ASTIdentifier, ASTExpression, ASTExpression>(node);
+		case ASTNodeKind::ASTAssignStatement:
+			return HasChildren<ASTIdentifier, ASTExpression>(node);
+		case ASTNodeKind::ASTWhileStatement:
+			return HasChildren<ASTExpression, ASTStatement>(node);
+		case ASTNodeKind::ASTIfElseStatement:
+			return HasChildren<ASTExpression, ASTStatement, ASTStatement>(node);
+		case ASTNodeKind::ASTBlockStatement:
+			return HasChildren<ASTStatementList>(node);
+		case ASTNodeKind::ASTStatementList:
+			return HasChildList<ASTStatement>(node);
+		case ASTNodeKind::ASTType:
+			if (data == ASTType::VT_CLASS) return HasChildren<ASTIdentifier>(node);
+			return HasChildren<>(node) && (data == ASTType::VT_INT || data == ASTType::VT_INTARRAY || data == ASTType::VT_BOOLEAN);
+		case ASTNodeKind::ASTArgDeclarationList1:
+			return HasChildren<>(node) || HasChildren<ASTVarDeclaration, ASTArgDeclarationList2>(node);
+		case ASTNodeKind::ASTArgDeclarationList2:
+		case ASTNodeKind::ASTVarDeclarationList:
+			return HasChildList<ASTVarDeclaration>(node);
+		case ASTNodeKind::ASTMethodDeclaration:
+			return HasChildren<ASTType, ASTIdentifier, ASTArgDeclarationList1, ASTVarDeclarationList, ASTStatementList, ASTExpression>(node);
+		case ASTNodeKind::ASTMethodDeclarationList:
+			return HasChildList<ASTMethodDeclaration>(node);
+		case ASTNodeKind::ASTVarDeclaration:
+			return HasChildren<ASTType, ASTIdentifier>(node);
+		case ASTNodeKind::ASTClassDeclaration:
+			return HasChildren<ASTIdentifier, ASTVarDeclarationList, ASTMethodDeclarationList>(node);
+		case ASTNodeKind::ASTDerivedClassDeclaration:
+			return HasChildren<ASTIdentifier, ASTIdentifier, ASTVarDeclarationList, ASTMethodDeclarationList>(node);
+		case ASTNodeKind::ASTClassDeclarationList:
+			return HasChildList<ASTClassDeclaration, ASTDerivedClassDeclaration>(node);
+		case ASTNodeKind::ASTMainClass:
+			return HasChildren<ASTIdentifier, ASTIdentifier, ASTStatement>(node);
+		case ASTNodeKind::ASTGoal:
+			return HasChildren<ASTMainClass, ASTClassDeclarationList>(node);
+		default:
+			return false; // ASTNode, ASTExpression and ASTStatement are never built, or the kind is unknown
+	}
+}
+
+bool FlatAST::Validate() const
+{
+	if (!count) return true;
+	if (first[ROOT] != ROOT + 1 || first[count] != count) return false;
+	for (NodeId id = 0; id < count; id++) {
+		// children follow their parent and the ranges are contiguous, so every node but the root has exactly one parent
+		if (first[id] <= id || first[id + 1] < first[id] || first[id + 1] > count) return false;
+		if ((size_t) kind[id] >= AST_NODE_KIND_COUNT) return false;
+	}
+	for (NodeId id = 0; id < count; id++) {
+		if (!IsValidFlatNode(FlatASTNode<ASTNode>(this, id), data[id])) return false;
+		if (kind[id] == ASTNodeKind::ASTIdentifier && data[id] >= symbols.size()) return false;
+	}
+	return true;
+}
+
+template <class T>
+static ASTNode *NewFlatNode(const FlatAST &ast, FlatAST::NodeId id)
+{
+	return new T(ast.loc[id]);
+}
+template <> ASTNode *NewFlatNode<ASTIdentifier>(const FlatAST &ast, FlatAST::NodeId id)
+{
+	return new ASTIdentifier(ast.loc[id], ast.symbols[ast.data[id]]);
+}
+template <> ASTNode *NewFlatNode<ASTNumber>(const FlatAST &ast, FlatAST::NodeId id)
+{
+	return new ASTNumber(ast.loc[id], (int) ast.data[id]);
+}
+template <> ASTNode *NewFlatNode<ASTBoolean>(const FlatAST &ast, FlatAST::NodeId id)
+{
+	return new ASTBoolean(ast.loc[id], (int) ast.data[id]);
+}
+template <> ASTNode *NewFlatNode<ASTBinaryExpression>(const FlatAST &ast, FlatAST::NodeId id)
+{
+	return new ASTBinaryExpression(ast.loc[id], {}, (int) ast.data[id]);
+}
+template <> ASTNode *NewFlatNode<ASTUnaryExpression>(const FlatAST &ast, FlatAST::NodeId id)
+{
+	return new ASTUnaryExpression(ast.loc[id], {}, (int) ast.data[id]);
+}
+template <> ASTNode *NewFlatNode<ASTType>(const FlatAST &ast, FlatAST::NodeId id)
+{
+	return new ASTType(ast.loc[id], {}, (ASTType::VarType) ast.data[id]);
+}
+
+// rebuild the ASTNode tree, order receives the node of each id
+ASTNode *FlatAST::Inflate(std::vector<ASTNode *> *order) const
+{
+	std::vector<ASTNode *> local_order;
+	if (!order) order = &local_order;
+	order->clear();
+	if (!count) return nullptr;
+
+	order->reserve(count);
+	for (NodeId id = 0; id < count; id++) {
+		ASTNode *node;
+		switch (kind[id]) {
+			case ASTNodeKind::ASTNode: node = NewFlatNode<ASTNode>(*this, id); break;
+#define MAKE_INFLATE(cls, super) case ASTNodeKind::cls: node = NewFlatNode<cls>(*this, id); break;
+			AST_NODE_KIND_LIST(MAKE_INFLATE)
+#undef MAKE_INFLATE
+			default: panic();
+		}
+		order->push_back(node);
+	}
+	for (NodeId id = 0; id < count; id++) {
+		ASTNode *node = (*order)[id];
+		node->ch.reserve(first[id + 1] - first[id]);
+		for (NodeId ch = first[id]; ch < first[id + 1]; ch++) {
+			node->AddChild((*order)[ch]);
+		}
+	}
+	return (*order)[ROOT];
+}
+
+void FlatAST::Clear()
+{
+	count = 0;
+	kind = nullptr;
+	loc = nullptr;
+	first = nullptr;
+	data = nullptr;
+	own_kind.clear();
+	own_loc.clear();
+	own_first.clear();
+	own_data.clear();
+	symbols.assign(1, Symbol());
+	symbol_index.clear();
+	symbol_index[Symbol()] = 0;
+}
+
+size_t FlatAST::GetMemorySize() const
+{
+	return own_kind.capacity() * sizeof(ASTNodeKind) + own_loc.capacity() * sizeof(yyltype)
+		+ own_first.capacity() * sizeof(NodeId) + own_data.capacity() * sizeof(uint32_t)
+		+ symbols.capacity() * sizeof(Symbol);
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+//////////////// FlatAST ////////////////
+
+// struct-of-arrays copy of an ASTNode tree, one column per field
+// nodes are numbered breadth-first from the root, so the children of a node
+// are the contiguous ids [first[id], first[id + 1])
+class FlatAST {
+public:
+	typedef uint32_t NodeId;
+	static const NodeId ROOT = 0;
+
+	// columns, owned by this object after Build() or pointing into a mapped file after Attach()
+	const ASTNodeKind *kind = nullptr;
+	const yyltype *loc = nullptr;
+	const NodeId *first = nullptr; // one extra entry at the end
+	const uint32_t *data = nullptr; // index into symbols, number or boolean value, operator token or ASTType::VarType
+	std::vector<Symbol> symbols; // symbols[0] is the empty name
+private:
+	size_t count = 0;
+	std::vector<ASTNodeKind> own_kind;
+	std::vector<yyltype> own_loc;
+	std::vector<NodeId> own_first;
+	std::vector<uint32_t> own_data;
+	std::unordered_map<Symbol, uint32_t> symbol_index;
+
+	uint32_t GetNodeData(ASTNode *node);
+public:
+	FlatAST() {}
+	FlatAST(const FlatAST &) = delete;
+	FlatAST &operator = (const FlatAST &) = delete;
+
+	void Build(ASTNode *root, std::vector<ASTNode *> *order = nullptr, size_t nodecount = 0); // nodecount: columns are reserved up front when known
+	void Attach(size_t count, const ASTNodeKind *kind, const yyltype *loc, const NodeId *first, const uint32_t *data, std::vector<Symbol> symbols);
+	uint32_t GetSymbolIndex(Symbol sym);
+	bool Validate() const; // true if the columns form a breadth-first tree shaped the way the parser builds it
+	ASTNode *Inflate(std::vector<ASTNode *> *order = nullptr) const;
+	void Clear();
+	size_t size() const { return count; }
+	size_t GetMemorySize() const;
+};
+
+// typed handle of one node in a FlatAST
+template <class T>
+class FlatASTNode {
+public:
+	const FlatAST *ast;
+	FlatAST::NodeId id;
+public:
+	FlatASTNode(const FlatAST *ast, FlatAST::NodeId id) : ast(ast), id(id) {}
+	template <class U> explicit FlatASTNode(const FlatASTNode<U> &r) : ast(r.ast), id(r.id) {}
+
+	ASTNodeKind GetKind() const { return ast->kind[id]; }
+	const yyltype &GetLoc() const { return ast->loc[id]; }
+	uint32_t GetChildCount() const { return ast->first[id + 1] - ast->first[id]; }
+	template <class U> bool Is() const
+	{
+		return U::KIND_FIRST <= GetKind() && GetKind() <= U::KIND_LAST;
+	}
+	template <class U> FlatASTNode<U> Child(uint32_t i) const
+	{
+		assert(i < GetChildCount());
+		FlatASTNode<U> ch(ast, ast->first[id] + i);
+		assert(ch.template Is<U>());
+		return ch;
+	}
+	Symbol GetSymbol() const { return ast->symbols[ast->data[id]]; }
+	int GetValue() const { return (int) ast->data[id]; }
+};
+
+
+//////////////// FlatAST visitor ////////////////
+
+// same dispatch and fallback rules as ASTStaticVisitor, on FlatASTNode handles
+template <class Derived>
+class FlatASTVisitor {
+protected:
+	const FlatAST *ast;
+
+	void VisitChildren(FlatASTNode<ASTNode> node, int level)
+	{
+		FlatAST::NodeId end = ast->first[node.id + 1];
+		for (FlatAST::NodeId ch = ast->first[node.id]; ch < end; ch++) {
+			Dispatch(ch, level + 1);
+		}
+	}
+public:
+	void Walk(const FlatAST &ast)
+	{
+		this->ast = &ast;
+		if (ast.size()) {
+			Dispatch(FlatAST::ROOT, 0);
+		}
+	}
+	void Dispatch(FlatAST::NodeId id, int level)
+	{
+		Derived *self = static_cast<Derived *>(this);
+		switch (ast->kind[id]) {
+			case ASTNodeKind::ASTNode: self->Visit(FlatASTNode<ASTNode>(ast, id), level); break;
+#define MAKE_DISPATCH(cls, super) case ASTNodeKind::cls: self->Visit(FlatASTNode<cls>(ast, id), level); break;
+			AST_NODE_KIND_LIST(MAKE_DISPATCH)
+#undef MAKE_DISPATCH
+			default: panic();
+		}
+	}
+
+	void Visit(FlatASTNode<ASTNode> node, int level)
+	{
+		VisitChildren(node, level);
+	}
+#define MAKE_FLAT_VISIT(cls, super) \
+	void Visit(FlatASTNode<cls> node, int level) \
+	{ \
+		static_cast<Derived *>(this)->Visit(FlatASTNode<super>(node), level); \
+	}
+	AST_NODE_KIND_LIST(MAKE_FLAT_VISIT)
+#undef MAKE_FLAT_VISIT
+};
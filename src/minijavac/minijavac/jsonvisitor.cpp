@@ -1,84 +1,344 @@
 #include "common.h"
 
-void JSONVisitor::OutEscapedString(const char *s)
-{
-	while (*s) {
-		switch (*s) {
-			case '\"': fputs("\\\"", fp); break;
-			case '\\': fputs("\\\\", fp); break;
-			case '\n': fputs("\\n", fp);  break;
-			case '\t': fputs("\\t", fp);  break;
-			default: fputc(*s, fp); break;
+JSONVisitor::JSONVisitor(CompilationContext &ctx) : ctx(ctx)
+{
+}
+
+////////// JSON //////////
+
+void JSONVisitor::OutEscapedString(const char *s, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *end = s + len, *run = s;
+	for (; s < end; s++) {
+		unsigned char c = *s;
+		if (c >= 0x20 && c != '\"' && c != '\\') continue;
+		out->Put(run, s - run);
+		run = s + 1;
+		switch (c) {
+			case '\"': out->Put("\\\"", 2); break;
+			case '\\': out->Put("\\\\", 2); break;
+			case '\n': out->Put("\\n", 2); break;
+			case '\t': out->Put("\\t", 2); break;
+			default:
+				out->Put("\\u00", 4);
+				out->Put(hex[c >> 4]);
+				out->Put(hex[c & 15]);
+				break;
+		}
+	}
+	out->Put(run, s - run);
+}
+
+bool JSONVisitor::DumpASTToJSON(FILE *fp, ASTNode *root, const char *src, size_t srclen)
+{
+	// every element but the first of a list is preceded by its comma, nothing is taken back
+	OutputBuffer buf(fp);
+	out = &buf;
+	cbor = false;
+	out->Put("{\"src\":\"");
+	OutEscapedString(src, srclen);
+	out->Put("\",\"ast\":[");
+	need_comma = false;
+	Dispatch(root);
+	out->Put("]}");
+	return buf.Flush();
+}
+
+void JSONVisitor::OutLocation(const yylinecol &loc)
+{
+	out->Put('[');
+	out->PutInt(loc.first_line);
+	out->Put(',');
+	out->PutInt(loc.first_column);
+	out->Put(',');
+	out->PutInt(loc.last_line);
+	out->Put(',');
+	out->PutInt(loc.last_column);
+	out->Put(']');
+}
+
+
+////////// indexed export //////////
+
+// for viewers that can't hold the whole tree, written in one pass without seeking:
+//   line 1 : header, {"format":"minijavac-ast-index", "version":1, "source":[offset,length], "nodes":total,
+//            "chunks":[[offset,length,nodes], ...], "classes":[{"name", "chunk", "location", "methods":[...]}, ...]}
+//   source : the raw source bytes
+//   chunks : one per line, chunk 0 is the root
+// offsets count from the byte after the header line, a chunk holds a node as in the JSON dump or,
+// for a page, a JSON array of consecutive children, nodes below it are left out in two ways:
+//   a class or method is a stub {"type", "location", "info", "chunk":n}, chunk n is the full node
+//   a node with too many descendants lists pages {"page":n} in its children, chunk n is the array
+
+static const size_t INDEX_PAGE_NODES = 1024; // nodes a chunk holds before children are split into pages
+
+size_t JSONVisitor::PlanPages(ASTNode *node)
+{
+	// counts the nodes written inline, stubs and page references count as one
+	size_t size = 0;
+	std::vector<uint32_t> first;
+	size_t page = INDEX_PAGE_NODES;
+	for (size_t i = 0; i < node->ch.size(); i++) {
+		size_t n = PlanPages(node->ch[i]);
+		if (page + n > INDEX_PAGE_NODES) {
+			first.push_back((uint32_t) i);
+			page = 0;
 		}
-		s++;
+		page += n;
+		size += n;
+	}
+	if (node->ch.size() > 1 && size > INDEX_PAGE_NODES) {
+		size = first.size();
+		pages[node] = std::move(first);
 	}
+	return IsChunkRoot(node) ? 1 : size + 1;
 }
-void JSONVisitor::OutQuotedString(const char *s)
+
+bool JSONVisitor::IsChunkRoot(ASTNode *node)
 {
-	fputc('\"', fp);
-	OutEscapedString(s);
-	fputc('\"', fp);
+	switch (node->kind) {
+		case ASTNodeKind::ASTMainClass:
+		case ASTNodeKind::ASTClassDeclaration:
+		case ASTNodeKind::ASTDerivedClassDeclaration:
+		case ASTNodeKind::ASTMethodDeclaration:
+			return true;
+		default:
+			return false;
+	}
 }
-void JSONVisitor::OutKeyValue(const char *key, const char *value)
+
+void JSONVisitor::VisitPages(ASTNode *node, const std::vector<uint32_t> &first)
 {
-	OutQuotedString(key);
-	fputc(':', fp);
-	OutQuotedString(value);
+	for (size_t i = 0; i < first.size(); i++) {
+		if (i) out->Put(',');
+		out->Put("{\"page\":");
+		out->PutInt(chunks.size());
+		out->Put('}');
+		uint32_t last = i + 1 < first.size() ? first[i + 1] : (uint32_t) node->ch.size();
+		chunks.push_back(Chunk { node, first[i], last, cur_chunk, 0, 0, 0 });
+	}
 }
-void JSONVisitor::OutKeyValue(const char *key, int value)
+
+static ASTIdentifier &GetDeclarationName(ASTNode *node)
+{
+	switch (node->kind) {
+		case ASTNodeKind::ASTMainClass: return node->As<ASTMainClass>().GetASTIdentifier();
+		case ASTNodeKind::ASTClassDeclaration: return node->As<ASTClassDeclaration>().GetASTIdentifier();
+		case ASTNodeKind::ASTDerivedClassDeclaration: return node->As<ASTDerivedClassDeclaration>().GetASTIdentifier();
+		default: return node->As<ASTMethodDeclaration>().GetASTIdentifier();
+	}
+}
+
+void JSONVisitor::OutIndexEntry(ASTNode *node, size_t chunk)
 {
-	OutQuotedString(key);
-	fputc(':', fp);
-	fprintf(fp, "%d", value);
+	const char *name = GetDeclarationName(node).id.c_str();
+	out->Put("{\"name\":\"");
+	OutEscapedString(name, strlen(name));
+	out->Put("\",\"chunk\":");
+	out->PutInt(chunk);
+	out->Put(",\"location\":");
+	OutLocation(ctx.ResolveLocation(node->loc));
 }
-void JSONVisitor::DumpASTToJSON(const char *jsonfile, ASTNode *root, const std::vector<std::string> &lines)
+
+bool JSONVisitor::DumpASTToIndex(FILE *fp, ASTNode *root, const char *src, size_t srclen)
 {
-	fp = fopen(jsonfile, "w");
-	assert(fp);
-	
-	std::string srctext;
-	for (const auto &l: lines) {
-		srctext += l;
+	// the chunks are formatted into memory first, their offsets are needed for the header
+	std::string data;
+	size_t total = 0;
+	{
+		OutputBuffer buf(data);
+		out = &buf;
+		cbor = false;
+		indexing = true;
+		pages.clear();
+		PlanPages(root);
+		chunks.assign(1, Chunk { root, 0, 0, 0, 0, 0, 0 });
+		for (cur_chunk = 0; cur_chunk < chunks.size(); cur_chunk++) {
+			Chunk c = chunks[cur_chunk];
+			size_t start = buf.Tell();
+			node_count = 0;
+			need_comma = false;
+			if (c.first == c.last) {
+				Dispatch(c.node);
+			} else {
+				out->Put('[');
+				for (uint32_t i = c.first; i < c.last; i++) {
+					Dispatch(c.node->ch[i], 1);
+				}
+				out->Put(']');
+			}
+			buf.Put('\n');
+			chunks[cur_chunk].offset = srclen + start;
+			chunks[cur_chunk].length = buf.Tell() - start;
+			chunks[cur_chunk].nodes = node_count;
+			total += node_count;
+		}
+		buf.Flush();
+		indexing = false;
+	}
+
+	// methods sit in their class's chunk or in a page below it
+	std::vector<std::vector<size_t> > methods(chunks.size());
+	for (size_t i = 1; i < chunks.size(); i++) {
+		if (chunks[i].node->kind == ASTNodeKind::ASTMethodDeclaration && chunks[i].first == chunks[i].last) {
+			size_t cls = chunks[i].parent;
+			while (chunks[cls].first != chunks[cls].last) cls = chunks[cls].parent;
+			methods[cls].push_back(i);
+		}
 	}
 
-	fputc('{', fp);
-		OutKeyValue("src", srctext.c_str()); fputc(',', fp);
-		OutQuotedString("ast"); fputc(':', fp);
-			fputc('[', fp);
-				fputc(' ', fp); // add a space for fseek() in case there's no child
-				root->Accept(*this);
-				fseek(fp, -1, SEEK_CUR); // eat last comma
-			fputc(']', fp);
-	fputc('}', fp);
+	OutputBuffer buf(fp);
+	out = &buf;
+	out->Put("{\"format\":\"minijavac-ast-index\",\"version\":1,\"source\":[0,");
+	out->PutInt(srclen);
+	out->Put("],\"nodes\":");
+	out->PutInt(total);
+	out->Put(",\"chunks\":[");
+	for (size_t i = 0; i < chunks.size(); i++) {
+		if (i) out->Put(',');
+		out->Put('[');
+		out->PutInt(chunks[i].offset);
+		out->Put(',');
+		out->PutInt(chunks[i].length);
+		out->Put(',');
+		out->PutInt(chunks[i].nodes);
+		out->Put(']');
+	}
+	out->Put("],\"classes\":[");
+	bool first = true;
+	for (size_t i = 1; i < chunks.size(); i++) {
+		ASTNode *node = chunks[i].node;
+		if (chunks[i].first != chunks[i].last || node->kind == ASTNodeKind::ASTMethodDeclaration) continue;
+		if (!first) out->Put(',');
+		first = false;
+		OutIndexEntry(node, i);
+		out->Put(",\"methods\":[");
+		for (size_t j = 0; j < methods[i].size(); j++) {
+			if (j) out->Put(',');
+			OutIndexEntry(chunks[methods[i][j]].node, methods[i][j]);
+			out->Put('}');
+		}
+		out->Put("]}");
+	}
+	out->Put("]}\n");
+	out->Put(src, srclen);
+	out->Put(data.data(), data.size());
+	chunks.clear();
+	pages.clear();
+	return buf.Flush();
+}
+
+
+////////// CBOR //////////
+
+// the same tree in CBOR (RFC 7049) with definite lengths, names are stored once:
+//   { "src": text, "types": [text, ...], "ast": [node] }
+//   node = [type index, [first_line, first_column, last_line, last_column], info, [node, ...]]
+
+enum CBORMajorType : uint8_t {
+	CBOR_UINT = 0,
+	CBOR_TEXT = 3,
+	CBOR_ARRAY = 4,
+	CBOR_MAP = 5,
+};
+
+void JSONVisitor::OutCBORHead(uint8_t major, uint64_t value)
+{
+	major <<= 5;
+	if (value < 24) {
+		out->Put((char) (major | value));
+	} else if (value <= 0xFF) {
+		out->Put((char) (major | 24));
+		out->Put((char) value);
+	} else if (value <= 0xFFFF) {
+		char b[3] = { (char) (major | 25), (char) (value >> 8), (char) value };
+		out->Put(b, 3);
+	} else if (value <= 0xFFFFFFFF) {
+		char b[5] = { (char) (major | 26), (char) (value >> 24), (char) (value >> 16), (char) (value >> 8), (char) value };
+		out->Put(b, 5);
+	} else {
+		out->Put((char) (major | 27));
+		for (int i = 56; i >= 0; i -= 8) {
+			out->Put((char) (value >> i));
+		}
+	}
+}
+void JSONVisitor::OutCBORText(const char *s, size_t len)
+{
+	OutCBORHead(CBOR_TEXT, len);
+	out->Put(s, len);
+}
 
-	fclose(fp);
+bool JSONVisitor::DumpASTToCBOR(FILE *fp, ASTNode *root, const char *src, size_t srclen)
+{
+	OutputBuffer buf(fp);
+	out = &buf;
+	cbor = true;
+	OutCBORHead(CBOR_MAP, 3);
+	OutCBORText("src", 3);
+	OutCBORText(src, srclen);
+	OutCBORText("types", 5);
+	OutCBORHead(CBOR_ARRAY, AST_NODE_KIND_COUNT);
+	for (size_t i = 0; i < AST_NODE_KIND_COUNT; i++) {
+		OutCBORText(GetKindName((ASTNodeKind) i), GetKindNameLength((ASTNodeKind) i));
+	}
+	OutCBORText("ast", 3);
+	OutCBORHead(CBOR_ARRAY, 1);
+	Dispatch(root);
+	return buf.Flush();
 }
 
+
+////////// nodes //////////
+
 void JSONVisitor::Visit(ASTNode *node, int level, std::function<void()> func)
 {
-	fputc('{', fp);
-		OutKeyValue("type", typeid(*node).name()); fputc(',', fp);
-		OutQuotedString("location"); fputc(':', fp);
-			fputc('[', fp);
-				fprintf(fp, "%d,", node->loc.first_line);
-				fprintf(fp, "%d,", node->loc.first_column);
-				fprintf(fp, "%d,", node->loc.last_line);
-				fprintf(fp, "%d", node->loc.last_column);
-			fputc(']', fp);
-			fputc(',', fp);
-		OutQuotedString("info"); fputc(':', fp);
-			fputc('"', fp);
-				func();
-			fputc('"', fp);
-			fputc(',', fp);
-		OutQuotedString("children"); fputc(':', fp);
-			fputc('[', fp);
-				fputc(' ', fp); // add a space for fseek() in case there's no child
-				VisitChildren(node, level);
-				fseek(fp, -1, SEEK_CUR); // eat last comma
-			fputc(']', fp);
-	fputc('}', fp);
-	fputc(',', fp);
+	info.clear();
+	func();
+	yylinecol loc = ctx.ResolveLocation(node->loc);
+
+	if (cbor) {
+		OutCBORHead(CBOR_ARRAY, 4);
+		OutCBORHead(CBOR_UINT, (uint8_t) node->kind);
+		OutCBORHead(CBOR_ARRAY, 4);
+		OutCBORHead(CBOR_UINT, loc.first_line);
+		OutCBORHead(CBOR_UINT, loc.first_column);
+		OutCBORHead(CBOR_UINT, loc.last_line);
+		OutCBORHead(CBOR_UINT, loc.last_column);
+		OutCBORText(info.data(), info.size());
+		OutCBORHead(CBOR_ARRAY, node->ch.size());
+		VisitChildren(node, level);
+		return;
+	}
+
+	if (need_comma) out->Put(',');
+	out->Put("{\"type\":\"");
+	out->Put(GetKindName(node->kind), GetKindNameLength(node->kind));
+	out->Put("\",\"location\":");
+	OutLocation(loc);
+	out->Put(",\"info\":\"");
+	OutEscapedString(info.data(), info.size());
+	if (indexing && level > 0 && IsChunkRoot(node)) {
+		// a stub, the subtree follows as a chunk of its own
+		out->Put("\",\"chunk\":");
+		out->PutInt(chunks.size());
+		out->Put('}');
+		chunks.push_back(Chunk { node, 0, 0, cur_chunk, 0, 0, 0 });
+		need_comma = true;
+		return;
+	}
+	node_count++;
+	out->Put("\",\"children\":[");
+	need_comma = false;
+	auto it = indexing ? pages.find(node) : pages.end();
+	if (it != pages.end()) {
+		VisitPages(node, it->second);
+	} else {
+		VisitChildren(node, level);
+	}
+	out->Put("]}");
+	need_comma = true;
 }
 void JSONVisitor::Visit(ASTNode *node, int level)
 {
@@ -87,36 +347,40 @@ void JSONVisitor::Visit(ASTNode *node, int level)
 void JSONVisitor::Visit(ASTIdentifier *node, int level)
 {
 	Visit(node, level, [&] {
-		fprintf(fp, "identifier="); OutEscapedString(node->id.c_str());
+		info += "identifier=";
+		info += node->id.c_str();
 	});
 }
 void JSONVisitor::Visit(ASTBoolean *node, int level)
 {
 	Visit(node, level, [&] {
-		fprintf(fp, "value=%d", node->val);
+		info += "value=" + std::to_string(node->val);
 	});
 }
 void JSONVisitor::Visit(ASTNumber *node, int level)
 {
 	Visit(node, level, [&] {
-		fprintf(fp, "value=%d", node->val);
+		info += "value=" + std::to_string(node->val);
 	});
 }
 void JSONVisitor::Visit(ASTBinaryExpression *node, int level)
 {
 	Visit(node, level, [&] {
-		fprintf(fp, "operator="); OutEscapedString(node->GetOperatorName());
+		info += "operator=";
+		info += node->GetOperatorName();
 	});
 }
 void JSONVisitor::Visit(ASTUnaryExpression *node, int level)
 {
 	Visit(node, level, [&] {
-		fprintf(fp, "operator="); OutEscapedString(node->GetOperatorName());
+		info += "operator=";
+		info += node->GetOperatorName();
 	});
 }
 void JSONVisitor::Visit(ASTType *node, int level)
 {
 	Visit(node, level, [&] {
-		fprintf(fp, "type="); OutEscapedString(node->GetTypeName());
+		info += "type=";
+		info += node->GetTypeName();
 	});
-}
\ No newline at end of file
+}
@@ -0,0 +1,35 @@
+#include "common.h"
+
+////////// library API //////////
+
+CompileResult Compile(const char *buf, size_t len, const CompileOptions &opt)
+{
+	// callers compile many small programs, keep the arena blocks between calls
+	static thread_local ASTNodePool pool;
+
+	CompileResult r;
+	{
+		CompilationContext cc(&pool);
+		cc.log = nullptr;
+		cc.LoadBuffer(buf, len);
+
+		bool cached = opt.use_cache && cc.LoadASTCache();
+		if (!cached) {
+			cc.ParseAST();
+		}
+		if (cc.goal) {
+			cc.codegen->GenerateCode(opt.link);
+			if (opt.use_cache && !cached && !cc.error_count) {
+				cc.SaveASTCache();
+			}
+		}
+
+		r.error_count = cc.error_count;
+		r.diagnostics = std::move(cc.diagnostics);
+		if (opt.link && !cc.error_count) {
+			r.image = std::move(cc.codegen->image);
+		}
+	}
+	pool.Reset();
+	return r;
+}
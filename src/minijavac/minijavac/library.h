@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+////////// library API //////////
+
+// the public interface of libminijavac, a program linking the library only needs this header
+
+class CompileOptions {
+public:
+	bool link = true; // false stops after code generation, for callers that only want the diagnostics
+	bool use_cache = false; // consult and fill the ASTCache, only when its directory has been set
+};
+
+class CompileResult {
+public:
+	int error_count = 0;
+	std::string diagnostics; // the errors as minijavac prints them, with source excerpts
+	std::vector<uint8_t> image; // the linked EXE file, empty unless linked without errors
+};
+
+// compiles one MiniJava source held in memory without touching the file system,
+// thread-safe, each calling thread keeps a warm AST arena between calls
+CompileResult Compile(const char *buf, size_t len, const CompileOptions &opt = CompileOptions());
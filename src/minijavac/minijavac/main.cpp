@@ -9,50 +9,111 @@ int main(int argc, char *argv[])
 	_CrtSetDbgFlag ( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );  
 	#endif
 
+	if (argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+		return RunBenchmark(argc - 2, argv + 2);
+	}
+	if (argc >= 2 && strcmp(argv[1], "--selftest") == 0) {
+		return RunSelfTest(argc - 2, argv + 2);
+	}
+
+	CompilationContext cc;
+	BatchOptions batch;
+	bool batch_mode = false;
+	ServerOptions server;
+	unsigned emit = EMIT_DEFAULT;
+	bool to_stdout = false;
+
+	int argi = 1;
+	for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+		if (strcmp(argv[argi], "--time") == 0) {
+			cc.show_timing = true;
+			batch.show_timing = true;
+			server.show_timing = true;
+		} else if (strcmp(argv[argi], "--cache") == 0 && argi + 1 < argc) {
+			ASTCache::Instance()->SetDirectory(argv[++argi]);
+		} else if (strcmp(argv[argi], "--batch") == 0) {
+			batch_mode = true;
+		} else if (strcmp(argv[argi], "--server") == 0 && argi + 1 < argc) {
+			server.socket_path = argv[++argi];
+		} else if (strcmp(argv[argi], "--jobs") == 0 && argi + 1 < argc) {
+			batch.jobs = server.jobs = cc.jobs = atoi(argv[++argi]);
+		} else if (strcmp(argv[argi], "--out") == 0 && argi + 1 < argc) {
+			batch.outdir = argv[++argi];
+		} else if (strncmp(argv[argi], "--emit=", 7) == 0 && ParseEmitList(argv[argi] + 7, emit)) {
+			batch.emit = server.emit = emit;
+		} else if (strcmp(argv[argi], "--stdout") == 0) {
+			to_stdout = true;
+		} else {
+			printf("usage: minijavac [--time] [--cache dir] [--emit=list] [--stdout] [--jobs n] source.java\n");
+			printf("       minijavac [--time] [--cache dir] [--emit=list] --batch [--jobs n] [--out dir] <file|dir>...\n");
+			printf("       minijavac [--time] [--cache dir] [--emit=list] --server <socket> [--jobs n]\n");
+			printf("       minijavac --bench <name> [args...]\n");
+			printf("       minijavac --selftest\n");
+			printf("--emit selects the outputs from exe,vars,asm,ast-txt,ast-json,ast-cbor,ast-index (default the first five, exe,vars,asm with --batch and --server)\n");
+			printf("--stdout writes the single artifact chosen by --emit to stdout, messages go to stderr\n");
+			return 1;
+		}
+	}
+
+	// with --stdout the artifact owns stdout, everything else is moved to stderr
+	FILE *msg = stdout;
+	if (to_stdout) {
+		if (batch_mode || !server.socket_path.empty() || emit == 0 || (emit & (emit - 1))) {
+			fprintf(stderr, "ERROR : --stdout needs a single compile and exactly one --emit artifact.\n");
+			return 1;
+		}
+		if (emit & EMIT_BINARY) {
+			_setmode(_fileno(stdout), _O_BINARY);
+		}
+		msg = stderr;
+		cc.log = stderr;
+	}
+
+	if (batch_mode) {
+		return RunBatch(batch, argc - argi, argv + argi);
+	}
+	if (!server.socket_path.empty()) {
+		CompileServer srv(server);
+		return srv.Run();
+	}
+
 	#ifdef _DEBUG
-	//MiniJavaC::Instance()->LoadFile("test.java");
+	//cc.LoadFile("test.java");
 
 
-	//MiniJavaC::Instance()->LoadFile("../../../mytests/duplicate.java");
+	//cc.LoadFile("../../../mytests/duplicate.java");
 
-	//MiniJavaC::Instance()->LoadFile("../../../tests/BinarySearch.java");
-	//MiniJavaC::Instance()->LoadFile("../../../tests/BinaryTree.java");
-	//MiniJavaC::Instance()->LoadFile("../../../tests/BubbleSort.java");
-	//MiniJavaC::Instance()->LoadFile("../../../tests/Factorial.java");
-	//MiniJavaC::Instance()->LoadFile("../../../tests/LinearSearch.java");
-	//MiniJavaC::Instance()->LoadFile("../../../tests/LinkedList.java");
-	//MiniJavaC::Instance()->LoadFile("../../../tests/QuickSort.java");
-	MiniJavaC::Instance()->LoadFile("../../../tests/TreeVisitor.java");
+	//cc.LoadFile("../../../tests/BinarySearch.java");
+	//cc.LoadFile("../../../tests/BinaryTree.java");
+	//cc.LoadFile("../../../tests/BubbleSort.java");
+	//cc.LoadFile("../../../tests/Factorial.java");
+	//cc.LoadFile("../../../tests/LinearSearch.java");
+	//cc.LoadFile("../../../tests/LinkedList.java");
+	//cc.LoadFile("../../../tests/QuickSort.java");
+	cc.LoadFile("../../../tests/TreeVisitor.java");
 
-	//MiniJavaC::Instance()->LoadFile("../../../tests/myDerivedClassTest.java");
+	//cc.LoadFile("../../../tests/myDerivedClassTest.java");
 	#else
 
-	if (argc >= 2) {
-		MiniJavaC::Instance()->LoadFile(argv[1]);
+	if (argi < argc) {
+		cc.LoadFile(argv[argi]);
 	}
 	
 	#endif
 
 
 
-	if (MiniJavaC::Instance()->src_loaded) {
-		MiniJavaC::Instance()->ParseAST();
-		if (MiniJavaC::Instance()->goal) {
-			MiniJavaC::Instance()->DumpASTToTextFile("out.ast.txt", true);
-			MiniJavaC::Instance()->DumpASTToJSON("out.ast.json"); 
-			CodeGen::Instance()->GenerateCode();
-			CodeGen::Instance()->DumpVars("out.var.txt");
-			CodeGen::Instance()->DumpSections("out.asm.txt");
-		}
+	if (cc.src_loaded) {
+		cc.Compile(to_stdout ? "-" : "out", emit);
 	} else {
-		MiniJavaC::Instance()->ReportError("no source file.");
+		cc.ReportError("no source file.");
 	}
 
-	int err_cnt = MiniJavaC::Instance()->error_count;
+	int err_cnt = cc.error_count;
 	if (err_cnt) {
-		printf("\n%d error(s) occured, compile failed.\n\n", err_cnt);
+		fprintf(msg, "\n%d error(s) occured, compile failed.\n\n", err_cnt);
 	} else {
-		printf("\nCompile successful.\n\n");
+		fprintf(msg, "\nCompile successful.\n\n");
 	}
 
 	#ifdef _DEBUG
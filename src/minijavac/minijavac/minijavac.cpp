@@ -1,30 +1,65 @@
 #include "common.h"
 #include "minijavac.tab.h"
 
-ErrFlagObj::ErrFlagObj()
+ErrFlagObj::ErrFlagObj(CompilationContext &ctx) : stack(ctx.errflag_stack)
 {
-	MiniJavaC::Instance()->errflag_stack.push_back(this);
+	stack.push_back(this);
+}
+ErrFlagObj::ErrFlagObj(DiagnosticBuffer &buf) : stack(buf.errflag_stack)
+{
+	stack.push_back(this);
 }
 ErrFlagObj::~ErrFlagObj()
 {
-	assert(MiniJavaC::Instance()->errflag_stack.back() == this);
-	MiniJavaC::Instance()->errflag_stack.pop_back();
+	assert(stack.back() == this);
+	stack.pop_back();
+}
+
+PhaseTimer::PhaseTimer() : start(std::chrono::steady_clock::now())
+{
+}
+double PhaseTimer::Elapsed()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
-MiniJavaC::MiniJavaC()
+ParseContext::ParseContext(CompilationContext *compiler) : compiler(compiler)
 {
 }
-MiniJavaC *MiniJavaC::Instance()
+ASTGoal *ParseContext::Parse(char *base, size_t size)
 {
-	static MiniJavaC inst;
-	return &inst;
+	yyscan_t scanner;
+	offset = 0;
+	goal = nullptr;
+	yyscanbegin(&scanner, this, base, size);
+	//yydebug = 1;
+	yyparse(scanner, this);
+	yyscanend(scanner);
+	return symbols_full ? nullptr : goal;
+}
+Symbol ParseContext::Intern(const yyltype &loc, const char *s, size_t len)
+{
+	Symbol sym(s, len);
+	if (sym.empty() && !symbols_full) {
+		symbols_full = true;
+		compiler->ReportError(loc, "too many distinct identifiers");
+	}
+	return sym;
 }
 
-void MiniJavaC::LoadFile(const char *filename)
+CompilationContext::CompilationContext(ASTNodePool *lent_pool) : own_pool(lent_pool ? nullptr : new ASTNodePool), codegen(new CodeGen(*this))
+{
+	pool = lent_pool ? lent_pool : own_pool.get();
+}
+CompilationContext::~CompilationContext()
+{
+}
+
+void CompilationContext::LoadFile(const char *filename)
 {
 	assert(!src_loaded);
 
-	printf("[*] Loading %s ...\n", filename);
+	Log("[*] Loading %s ...\n", filename);
 
 	FILE *fp = fopen(filename, "r");
 	if (!fp) {
@@ -32,61 +67,105 @@ void MiniJavaC::LoadFile(const char *filename)
 		return;
 	}
 
-	int ch;
+	// read whole file into one buffer, flex will scan it in place
+	fseek(fp, 0, SEEK_END);
+	long fsize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
 
-	lines.clear();
-	lines.push_back(std::string());
-
-	while ((ch = fgetc(fp)) != EOF) {
-		lines.back().push_back(ch);
-		if (ch == '\n') {
-			lines.push_back(std::string());
-		}
-	}
+	src.resize(fsize + 2);
+	srclen = fread(src.data(), 1, fsize, fp); // may be less than fsize in text mode
+	src.resize(srclen + 2);
+	src[srclen] = src[srclen + 1] = 0;
 
 	fclose(fp);
 
-	ln = col = 0;
+	MakeLineTable();
+	src_loaded = true;
+}
 
+void CompilationContext::LoadBuffer(const char *buf, size_t len)
+{
+	assert(!src_loaded);
+
+	src.assign(buf, buf + len);
+	srclen = len;
+	src.push_back(0);
+	src.push_back(0);
+
+	MakeLineTable();
 	src_loaded = true;
-/*	for (auto &line : lines) {
-		printf("%s", line.c_str());
-	}*/
 }
 
-int MiniJavaC::GetChar()
+void CompilationContext::MakeLineTable()
 {
-	while (ln < lines.size() && col >= lines[ln].length()) {
-		ln++;
-		col = 0;
-	}
-	if (ln >= lines.size()) {
-		return EOF;
+	linestart.clear();
+	linestart.push_back(0);
+	for (size_t i = 0; i < srclen; i++) {
+		if (src[i] == '\n') {
+			linestart.push_back(i + 1);
+		}
 	}
-	return lines[ln][col++];
 }
 
-void MiniJavaC::DumpContent(const yyltype &loc)
+size_t CompilationContext::GetSourceSize()
 {
-	DumpContent(loc, stdout);
+	return srclen;
 }
-void MiniJavaC::DumpContent(const yyltype &loc, FILE *fp)
+size_t CompilationContext::GetLineCount()
 {
-	fprintf(fp, " at [(%d,%d):(%d,%d)]\n", loc.first_line, loc.first_column, loc.last_line, loc.last_column);
+	return linestart.size();
+}
+
+const char *CompilationContext::GetSourceLine(size_t line, size_t &len)
+{
+	const char *p = src.data() + linestart[line - 1];
+	len = (line < linestart.size() ? linestart[line] : srclen) - linestart[line - 1];
+	while (len > 0 && (p[len - 1] == '\n' || p[len - 1] == '\r')) len--;
+	return p;
+}
+
+yylinecol CompilationContext::ResolveLocation(const yyltype &loc)
+{
+	// binary search the line-start table, columns are 1-based byte counts
+	auto resolve = [&](uint32_t off, int &line, int &column) {
+		line = std::upper_bound(linestart.begin(), linestart.end(), off) - linestart.begin();
+		column = off - linestart[line - 1] + 1;
+	};
+	yylinecol r;
+	resolve(loc.first, r.first_line, r.first_column);
+	resolve(loc.last, r.last_line, r.last_column);
+	return r;
+}
+
+void CompilationContext::DumpContent(const yyltype &loc, FILE *fp)
+{
+	fputs(FormatContent(loc).c_str(), fp);
+}
+std::string CompilationContext::FormatContent(const yyltype &srcloc)
+{
+	std::string r;
+	char buf[64];
+	yylinecol loc = ResolveLocation(srcloc);
+	snprintf(buf, sizeof(buf), " at [(%d,%d):(%d,%d)]\n", loc.first_line, loc.first_column, loc.last_line, loc.last_column);
+	r += buf;
 	int tabwidth = 4;
 	char ch = ' ', ch2;
 	for (int i = loc.first_line; i <= loc.last_line; i++) {
-		if (i - 1 < lines.size()) {
-			fprintf(fp, "%5u | ", i);
-			for (int j = 1; j <= lines[i - 1].length(); j++) {
-				if (lines[i - 1][j - 1] != '\t') {
-					fprintf(fp, "%c", lines[i - 1][j - 1]);
+		if (i - 1 < linestart.size()) {
+			const char *line = src.data() + linestart[i - 1];
+			size_t len = (i < linestart.size() ? linestart[i] : srclen) - linestart[i - 1];
+			snprintf(buf, sizeof(buf), "%5u | ", i);
+			r += buf;
+			for (int j = 1; j <= len; j++) {
+				if (line[j - 1] != '\t') {
+					r += line[j - 1];
 				} else {
-					fprintf(fp, "%*s", tabwidth, "");
+					r.append(tabwidth, ' ');
 				}
 			}
-			fprintf(fp, "%5s | ", "");
-			for (int j = 1; j <= lines[i - 1].length(); j++) {
+			snprintf(buf, sizeof(buf), "%5s | ", "");
+			r += buf;
+			for (int j = 1; j <= len; j++) {
 				ch2 = ch;
 				if (i == loc.first_line && j == loc.first_column) {
 					ch = '~';
@@ -96,56 +175,266 @@ void MiniJavaC::DumpContent(const yyltype &loc, FILE *fp)
 					ch = ' ';
 					ch2 = '^';
 				}
-				fprintf(fp, "%c", ch2);
-				if (lines[i - 1][j - 1] == '\t') {
-					for (int k = 1; k < tabwidth; k++) {
-						fprintf(fp, "%c", ch2);
-					}
-				}
+				r.append(line[j - 1] == '\t' ? tabwidth : 1, ch2);
 			}
-			fprintf(fp, "\n");
+			r += '\n';
 		} else {
-			fprintf(fp, "%5s | unable to dump source code\n", "");
+			snprintf(buf, sizeof(buf), "%5s | unable to dump source code\n", "");
+			r += buf;
 		}
 	}
+	return r;
 }
 
-void MiniJavaC::ReportError(const std::string &msg, bool important)
+void CompilationContext::Log(const char *fmt, ...)
+{
+	if (!log) return;
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(log, fmt, ap);
+	va_end(ap);
+}
+
+void CompilationContext::ReportError(const std::string &msg, bool important)
 {
 	if (errflag_stack.empty() || !errflag_stack.back()->flag) {
-		printf("ERROR : %s\n", msg.c_str());
-		printf("\n");
+		diagnostics += "ERROR : " + msg + "\n\n";
+		Log("ERROR : %s\n\n", msg.c_str());
 		error_count++;
 		if (important && !errflag_stack.empty()) errflag_stack.back()->flag = true;
 	}
 }
-void MiniJavaC::ReportError(const yyltype &loc, const std::string &msg, bool important)
+void CompilationContext::ReportError(const yyltype &loc, const std::string &msg, bool important)
 {
 	if (errflag_stack.empty() || !errflag_stack.back()->flag) {
-		DumpContent(loc);
+		std::string content = FormatContent(loc);
+		diagnostics += content;
+		Log("%s", content.c_str());
 		ReportError(msg);
 		if (important && !errflag_stack.empty()) errflag_stack.back()->flag = true;
 	}
 }
 
 
-void MiniJavaC::ParseAST()
+void CompilationContext::ParseAST()
 {
-	printf("[*] Generating AST ...\n");
-	yycolumn = 1;
-	//yydebug = 1;
-	yyparse();
-	ASTNodePool::Instance()->Shrink();
+	Log("[*] Generating AST ...\n");
+	PhaseTimer t;
+	ASTNodePool::Scope scope(pool);
+	ParseContext ctx(this);
+	goal = ctx.Parse(src.data(), src.size());
+	double parse_ms = t.Elapsed() * 1000;
+	t = PhaseTimer();
+	size_t dropped = pool->Shrink(goal);
+	if (show_timing) {
+		Log(" [*] Parsed %u lines with %s parser in %.3f ms\n", (unsigned) GetLineCount(), yyskeleton, parse_ms);
+		Log(" [*] Unregistered %u unreachable AST nodes in %.3f ms, %u bytes of arena in use\n", (unsigned) dropped, t.Elapsed() * 1000, (unsigned) pool->GetUsedSize());
+	}
+}
+
+DiagnosticBuffer::DiagnosticBuffer(CompilationContext &ctx) : ctx(ctx)
+{
+}
+void DiagnosticBuffer::ReportError(const std::string &msg, bool important)
+{
+	if (errflag_stack.empty() || !errflag_stack.back()->flag) {
+		std::string text = "ERROR : " + msg + "\n\n";
+		diagnostics += text;
+		if (ctx.log) log += text;
+		error_count++;
+		if (important && !errflag_stack.empty()) errflag_stack.back()->flag = true;
+	}
+}
+void DiagnosticBuffer::ReportError(const yyltype &loc, const std::string &msg, bool important)
+{
+	if (errflag_stack.empty() || !errflag_stack.back()->flag) {
+		std::string content = ctx.FormatContent(loc);
+		diagnostics += content;
+		if (ctx.log) log += content;
+		ReportError(msg);
+		if (important && !errflag_stack.empty()) errflag_stack.back()->flag = true;
+	}
+}
+void DiagnosticBuffer::Log(const char *fmt, ...)
+{
+	if (!ctx.log) return;
+	char buf[256];
+	va_list ap;
+	va_start(ap, fmt);
+	int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (len < 0) return;
+	if ((size_t) len < sizeof(buf)) {
+		log.append(buf, len);
+	} else {
+		std::vector<char> big(len + 1);
+		va_start(ap, fmt);
+		vsnprintf(big.data(), big.size(), fmt, ap);
+		va_end(ap);
+		log.append(big.data(), len);
+	}
+}
+void DiagnosticBuffer::Flush()
+{
+	if (ctx.log) fputs(log.c_str(), ctx.log);
+	ctx.diagnostics += diagnostics;
+	ctx.error_count += error_count;
+	log.clear();
+	diagnostics.clear();
+	error_count = 0;
+}
+
+bool CompilationContext::LoadASTCache()
+{
+	if (!ASTCache::Instance()->Enabled()) return false;
+	PhaseTimer t;
+	srchash = ASTCache::HashSource(src.data(), srclen);
+	ClassInfoList clsinfo;
+	ASTNodePool::Scope scope(pool);
+	if (!ASTCache::Instance()->Load(srchash, srclen, goal, clsinfo)) {
+		Log("[*] AST cache miss %016llx (%.3f ms)\n", (unsigned long long) srchash, t.Elapsed() * 1000);
+		return false;
+	}
+	codegen->SetClassInfoList(std::move(clsinfo));
+	Log("[*] AST cache hit %016llx, %u nodes loaded in %.3f ms\n", (unsigned long long) srchash, (unsigned) pool->GetNodeCount(), t.Elapsed() * 1000);
+	return true;
+}
+
+void CompilationContext::SaveASTCache()
+{
+	if (!ASTCache::Instance()->Enabled()) return;
+	PhaseTimer t;
+	if (ASTCache::Instance()->Save(srchash, srclen, goal, pool->GetNodeCount(), codegen->clsinfo)) {
+		Log("[*] AST cache saved to %s in %.3f ms\n", ASTCache::Instance()->GetPath(srchash).c_str(), t.Elapsed() * 1000);
+	} else {
+		Log("[*] Can't write AST cache %s\n", ASTCache::Instance()->GetPath(srchash).c_str());
+	}
+}
+
+bool CompilationContext::DumpASTToTextFile(const char *txtfile, bool dumpcontent)
+{
+	PrintVisitor v(*this);
+	return v.DumpASTToTextFile(txtfile, goal, dumpcontent);
+}
+
+bool CompilationContext::DumpASTToJSON(const char *jsonfile)
+{
+	FILE *fp = jsonfile ? fopen(jsonfile, "w") : stdout;
+	if (!fp) return false;
+	JSONVisitor v(*this);
+	bool ok = v.DumpASTToJSON(fp, goal, src.data(), srclen);
+	if (jsonfile) fclose(fp);
+	return ok;
+}
+
+bool CompilationContext::DumpASTToCBOR(const char *cborfile)
+{
+	FILE *fp = cborfile ? fopen(cborfile, "wb") : stdout;
+	if (!fp) return false;
+	JSONVisitor v(*this);
+	bool ok = v.DumpASTToCBOR(fp, goal, src.data(), srclen);
+	if (cborfile) fclose(fp);
+	return ok;
 }
 
-void MiniJavaC::DumpASTToTextFile(const char *txtfile, bool dumpcontent)
+bool CompilationContext::DumpASTToIndex(const char *idxfile)
 {
-	PrintVisitor v;
-	v.DumpASTToTextFile(txtfile, goal.get(), dumpcontent);
+	FILE *fp = idxfile ? fopen(idxfile, "wb") : stdout;
+	if (!fp) return false;
+	JSONVisitor v(*this);
+	bool ok = v.DumpASTToIndex(fp, goal, src.data(), srclen);
+	if (idxfile) fclose(fp);
+	return ok;
 }
 
-void MiniJavaC::DumpASTToJSON(const char *jsonfile)
+void CompilationContext::Compile(const std::string &outbase, unsigned emit)
 {
-	JSONVisitor v;
-	v.DumpASTToJSON(jsonfile, goal.get(), lines);
-}
\ No newline at end of file
+	bool cached = LoadASTCache();
+	if (!cached) {
+		ParseAST();
+	}
+	if (!goal) return;
+
+	// the AST is read-only from here on, its dumps are written while code is generated,
+	// the sections and class info are read-only once linked
+	ArtifactWriter writer(background_writer);
+	bool tostdout = outbase == "-";
+	auto path = [tostdout](const std::string &file) { return tostdout ? nullptr : file.c_str(); };
+	std::string astfile = outbase + ".ast.txt", jsonfile = outbase + ".ast.json", cborfile = outbase + ".ast.cbor", idxfile = outbase + ".ast.idx";
+	if (emit & EMIT_AST_TXT) {
+		writer.Submit(astfile, [this, &astfile, path] { return DumpASTToTextFile(path(astfile), true); });
+	}
+	if (emit & EMIT_AST_JSON) {
+		writer.Submit(jsonfile, [this, &jsonfile, path] { return DumpASTToJSON(path(jsonfile)); });
+	}
+	if (emit & EMIT_AST_CBOR) {
+		writer.Submit(cborfile, [this, &cborfile, path] { return DumpASTToCBOR(path(cborfile)); });
+	}
+	if (emit & EMIT_AST_INDEX) {
+		writer.Submit(idxfile, [this, &idxfile, path] { return DumpASTToIndex(path(idxfile)); });
+	}
+
+	codegen->GenerateCode(!!(emit & (EMIT_EXE | EMIT_ASM)));
+
+	std::string exefile = outbase + ".exe", varfile = outbase + ".var.txt", asmfile = outbase + ".asm.txt";
+	if (emit & EMIT_EXE) {
+		writer.Submit(exefile, [this, &exefile, path] { return codegen->WriteEXE(path(exefile)); });
+	}
+	if (emit & EMIT_VARS) {
+		writer.Submit(varfile, [this, &varfile, path] { return codegen->DumpVars(path(varfile)); });
+	}
+	if (emit & EMIT_ASM) {
+		writer.Submit(asmfile, [this, &asmfile, path] { return codegen->DumpSections(path(asmfile)); });
+	}
+	if (!cached && !error_count) {
+		SaveASTCache();
+	}
+
+	for (auto &file: writer.Finish()) {
+		ReportError("Can't open output file " + file);
+	}
+}
+
+static const struct {
+	const char *name;
+	const char *suffix;
+	unsigned flag;
+} emit_names[] = {
+	{ "exe", ".exe", EMIT_EXE },
+	{ "vars", ".var.txt", EMIT_VARS },
+	{ "asm", ".asm.txt", EMIT_ASM },
+	{ "ast-txt", ".ast.txt", EMIT_AST_TXT },
+	{ "ast-json", ".ast.json", EMIT_AST_JSON },
+	{ "ast-cbor", ".ast.cbor", EMIT_AST_CBOR },
+	{ "ast-index", ".ast.idx", EMIT_AST_INDEX },
+};
+
+bool ParseEmitList(const char *list, unsigned &emit)
+{
+	emit = 0;
+	std::string s(list);
+	for (size_t p = 0, q; p <= s.size(); p = q + 1) {
+		q = std::min(s.find(',', p), s.size());
+		std::string name = s.substr(p, q - p);
+		bool found = false;
+		for (auto &e: emit_names) {
+			if (name == e.name) {
+				emit |= e.flag;
+				found = true;
+			}
+		}
+		if (!found) return false;
+	}
+	return true;
+}
+
+std::string GetEmitFiles(const std::string &outbase, unsigned emit)
+{
+	std::string r;
+	for (auto &e: emit_names) {
+		if (emit & e.flag) {
+			r += outbase + e.suffix + "\n";
+		}
+	}
+	return r;
+}
@@ -2,6 +2,13 @@
 
 #define YYLTYPE yyltype
 struct yyltype
+{
+  uint32_t first; // source offset of first char
+  uint32_t last;  // source offset of last char
+};
+
+// line/column form of a yyltype, resolved on demand
+struct yylinecol
 {
   int first_line;
   int first_column;
@@ -13,48 +20,160 @@ class ASTNode;
 
 #define YYSTYPE ASTNode *
 
-extern int yycolumn;
-extern int yylex();
-extern void yyerror(const char *s);
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+class ParseContext;
+
+extern int yylex(YYSTYPE *lvalp, YYLTYPE *llocp, yyscan_t scanner);
+extern void yyerror(YYLTYPE *llocp, yyscan_t scanner, ParseContext *ctx, const char *s);
+extern void yyscanbegin(yyscan_t *scanner, ParseContext *ctx, char *base, size_t size);
+extern void yyscanend(yyscan_t scanner);
+extern const char *yyskeleton;
+
+
+////// timing //////
+
+class PhaseTimer {
+	std::chrono::steady_clock::time_point start;
+public:
+	PhaseTimer();
+	double Elapsed(); // seconds since construction
+};
+
+
+////// output artifacts //////
 
+enum EmitFlags : unsigned {
+	EMIT_EXE = 1 << 0, // <outbase>.exe
+	EMIT_ASM = 1 << 1, // <outbase>.asm.txt, machine code and disassembly
+	EMIT_AST_JSON = 1 << 2, // <outbase>.ast.json
+	EMIT_AST_TXT = 1 << 3, // <outbase>.ast.txt, with the source of every node
+	EMIT_VARS = 1 << 4, // <outbase>.var.txt, variable layout
+	EMIT_AST_CBOR = 1 << 5, // <outbase>.ast.cbor, the JSON tree in binary
+	EMIT_AST_INDEX = 1 << 6, // <outbase>.ast.idx, the JSON tree in chunks loadable on demand
+	EMIT_DEFAULT = EMIT_EXE | EMIT_ASM | EMIT_AST_JSON | EMIT_AST_TXT | EMIT_VARS,
+	EMIT_ALL = EMIT_DEFAULT | EMIT_AST_CBOR | EMIT_AST_INDEX,
+	EMIT_BINARY = EMIT_EXE | EMIT_AST_CBOR | EMIT_AST_INDEX, // byte offsets or raw bytes, no newline translation
+};
+
+// parses a --emit list such as "exe,asm,ast-json,ast-txt,ast-cbor,vars"
+bool ParseEmitList(const char *list, unsigned &emit);
+// the output files an emit mask produces, each followed by '\n'
+std::string GetEmitFiles(const std::string &outbase, unsigned emit);
 
-////// the MiniJavaC class //////
+
+////// the compilation context //////
 
 class ASTGoal;
+class ASTNodePool;
+class CodeGen;
+class CompilationContext;
 
+class DiagnosticBuffer;
 class ErrFlagObj {
+	std::vector<ErrFlagObj *> &stack;
 public:
 	bool flag = false;
-	ErrFlagObj();
+	ErrFlagObj(CompilationContext &ctx);
+	ErrFlagObj(DiagnosticBuffer &buf);
 	~ErrFlagObj();
 };
 
-class MiniJavaC {
+// everything one compilation owns: the source, the AST arena, diagnostics,
+// and the CodeGen holding class info and section buffers,
+// independent contexts may live side by side in one process
+class CompilationContext {
 	friend class ErrFlagObj;
 
-	std::vector<std::string> lines;
-	unsigned ln, col;
+	std::vector<char> src; // whole source text, followed by two NULs for flex
+	size_t srclen;
+	uint64_t srchash = 0;
+	std::vector<size_t> linestart; // offset of first char of each line
 	std::vector<ErrFlagObj *> errflag_stack;
 
+	std::unique_ptr<ASTNodePool> own_pool;
+
+	void MakeLineTable();
+
 public:
-	std::shared_ptr<ASTGoal> goal;
+	ASTNodePool *pool; // own_pool, or one lent by the caller to be reused across compilations
+	std::unique_ptr<CodeGen> codegen;
+	ASTGoal *goal = nullptr;
 	bool src_loaded = false;
 	int error_count = 0;
+	bool show_timing = false;
+	bool background_writer = true; // write the artifacts on an ArtifactWriter thread
+	int jobs = 0; // threads for the phases that run in parallel, 0 = one per hardware thread
+	FILE *log = stdout; // progress messages and diagnostics, nullptr for none
+	std::string diagnostics; // every reported error, as written to the log
 
-private:
-	MiniJavaC();
 public:
-	int GetChar();
+	CompilationContext(ASTNodePool *lent_pool = nullptr);
+	~CompilationContext();
+	CompilationContext(const CompilationContext &) = delete;
+	CompilationContext &operator = (const CompilationContext &) = delete;
+
+	yylinecol ResolveLocation(const yyltype &loc);
 	void ReportError(const yyltype &loc, const std::string &msg, bool important = false);
 	void ReportError(const std::string &msg, bool important = false);
-	static MiniJavaC *Instance();
+	void Log(const char *fmt, ...);
 
 	void LoadFile(const char *filename);
+	void LoadBuffer(const char *buf, size_t len);
+	size_t GetSourceSize();
+	size_t GetLineCount();
+	const char *GetSourceLine(size_t line, size_t &len); // 1-based, len excludes the line break
+	std::string FormatContent(const yyltype &loc); // location and source lines with the range underlined
 	void DumpContent(const yyltype &loc, FILE *fp);
-	void DumpContent(const yyltype &loc);
 	void ParseAST();
-	void DumpASTToTextFile(const char *txtfile, bool dumpcontent);
-	void DumpASTToJSON(const char *jsonfile);
+	bool LoadASTCache();
+	void SaveASTCache();
+	// a null file name means stdout
+	bool DumpASTToTextFile(const char *txtfile, bool dumpcontent);
+	bool DumpASTToJSON(const char *jsonfile);
+	bool DumpASTToCBOR(const char *cborfile);
+	bool DumpASTToIndex(const char *idxfile);
+
+	// parse (or load from ASTCache) and generate code, writes the artifacts selected by emit,
+	// linking is skipped when neither the exe nor the listing is wanted,
+	// with outbase "-" the single selected artifact goes to stdout
+	void Compile(const std::string &outbase, unsigned emit);
+};
+
+// ReportError() and Log() for work running beside the rest of a compilation,
+// kept until Flush() appends them to the context, so the output doesn't depend on the schedule
+class DiagnosticBuffer {
+	friend class ErrFlagObj;
+
+	CompilationContext &ctx;
+	std::vector<ErrFlagObj *> errflag_stack;
+	std::string log; // what would have gone to the context's log
+	std::string diagnostics;
+	int error_count = 0;
+public:
+	DiagnosticBuffer(CompilationContext &ctx);
+	void ReportError(const yyltype &loc, const std::string &msg, bool important = false);
+	void ReportError(const std::string &msg, bool important = false);
+	void Log(const char *fmt, ...);
+	void Flush(); // on the thread that owns the context, empties the buffer
 };
 
 
+////// the parse context //////
+
+// everything one run of the scanner and parser touches,
+// parses with different contexts may run on different threads
+class ParseContext {
+public:
+	CompilationContext *compiler; // receives syntax errors
+	uint32_t offset = 0; // source offset of the next token
+	ASTGoal *goal = nullptr;
+	bool symbols_full = false; // the SymbolTable ran out of ids, the program is not compiled
+public:
+	ParseContext(CompilationContext *compiler);
+	ASTGoal *Parse(char *base, size_t size); // base[size - 2] and base[size - 1] must be NUL, nodes go to the current ASTNodePool
+	Symbol Intern(const yyltype &loc, const char *s, size_t len); // for the scanner, reports a full SymbolTable once
+};
@@ -1,15 +1,32 @@
 %{
 #include "common.h"
 
+#define YYLLOC_DEFAULT(Cur, Rhs, N) \
+	do { \
+		if (N) { \
+			(Cur).first = YYRHSLOC(Rhs, 1).first; \
+			(Cur).last = YYRHSLOC(Rhs, N).last; \
+		} else { \
+			(Cur).first = (Cur).last = YYRHSLOC(Rhs, 0).last; \
+		} \
+	} while (0)
 
 %}
 
 %locations
-%debug
-%glr-parser
+%expect 0
+
+// no globals: the scanner handle and the ParseContext are passed down
+%define api.pure
+%param {yyscan_t scanner}
+%parse-param {ParseContext *ctx}
 
 %define parse.error verbose
 
+// the grammar is LALR(1), the skeleton is chosen by the build:
+//   Release: default LALR(1) parser
+//   Debug:   --skeleton=glr.c --debug
+
 
 %token TOK_CLASS
 %token TOK_PUBLIC
@@ -57,20 +74,20 @@
 %left TOK_ADD TOK_SUB
 %left TOK_MUL
 %right TOK_NOT
-%left TOK_DOT
+%left TOK_DOT TOK_LS
 
 
 %%
 Goal
   : MainClass ClassDeclarationList
-    { MiniJavaC::Instance()->goal = std::dynamic_pointer_cast<ASTGoal>((new ASTGoal(@$, { $1, $2 }))->GetSharedPtr()); }
+    { ctx->goal = new ASTGoal(@$, { $1, $2 }); }
 ;
 
 ClassDeclarationList
   :
     { $$ = new ASTClassDeclarationList(@$); }
   | ClassDeclarationList ClassDeclaration
-    { $$ = new ASTClassDeclarationList(@$, { $1, $2 }); }
+    { $$ = $1->Append(@$, $2); }
 ;
 
 MainClass
@@ -89,14 +106,14 @@ VarDeclarationList
   :
 	{ $$ = new ASTVarDeclarationList(@$); }
   | VarDeclarationList VarDeclaration TOK_SEMI
-    { $$ = new ASTVarDeclarationList(@$, { $1, $2 }); }
+    { $$ = $1->Append(@$, $2); }
 ;
 
 MethodDeclarationList
   :
 	{ $$ = new ASTMethodDeclarationList(@$); }
   | MethodDeclarationList MethodDeclaration
-    { $$ = new ASTMethodDeclarationList(@$, { $1, $2 }); }
+    { $$ = $1->Append(@$, $2); }
 ;
 
 VarDeclaration
@@ -105,10 +122,26 @@ VarDeclaration
 ;
 
 MethodDeclaration
-  : TOK_PUBLIC Type Identifier TOK_LP ArgDeclarationList1 TOK_RP TOK_LB VarDeclarationList StatementList TOK_RETURN Expression TOK_SEMI TOK_RB
+  : TOK_PUBLIC Type Identifier TOK_LP ArgDeclarationList1 TOK_RP TOK_LB VarDeclarationList MethodStatementList TOK_RETURN Expression TOK_SEMI TOK_RB
     { $$ = new ASTMethodDeclaration(@$, { $2, $3, $5, $8, $9, $11 }); }
 ;
 
+// a statement may start with an identifier just like a class-typed VarDeclaration,
+// so the empty StatementList can only be reduced when the body has no statement
+MethodStatementList
+  :
+	{ $$ = new ASTStatementList(@$); }
+  | MethodStatementList2
+    { $$ = $1; }
+;
+
+MethodStatementList2
+  : Statement
+    { $$ = new ASTStatementList(@$, { $1 }); }
+  | MethodStatementList2 Statement
+    { $$ = $1->Append(@$, $2); }
+;
+
 ArgDeclarationList1
   :
 	{ $$ = new ASTArgDeclarationList1(@$); }
@@ -120,7 +153,7 @@ ArgDeclarationList2
   :
 	{ $$ = new ASTArgDeclarationList2(@$); }
   | ArgDeclarationList2 TOK_COM VarDeclaration
-	{ $$ = new ASTArgDeclarationList2(@$, { $1, $3 }); }
+	{ $$ = $1->Append(@$, $3); }
 ;
 
 Type
@@ -153,7 +186,7 @@ StatementList
   :
 	{ $$ = new ASTStatementList(@$); }
   | StatementList Statement
-    { $$ = new ASTStatementList(@$, { $1, $2} ); }
+    { $$ = $1->Append(@$, $2); }
 ;
 
 Expression
@@ -204,7 +237,7 @@ ArgExpressionList2
   :
 	{ $$ = new ASTArgExpressionList2(@$); }
   | ArgExpressionList2 TOK_COM Expression
-	{ $$ = new ASTArgExpressionList2(@$, { $1, $3 }); }
+	{ $$ = $1->Append(@$, $3); }
 ;
 
 Identifier
@@ -213,8 +246,10 @@ Identifier
 ;
 %%
 
-void yyerror(const char *s)
+const char *yyskeleton = YYSKELETON_NAME;
+
+void yyerror(YYLTYPE *llocp, yyscan_t scanner, ParseContext *ctx, const char *s)
 {
-	MiniJavaC::Instance()->ReportError(yylloc, s);
+	ctx->compiler->ReportError(*llocp, s);
 }
 
@@ -1,34 +1,104 @@
 #include "common.h"
 
-void PrintVisitor::DumpASTToTextFile(const char *txtfile, ASTNode *root, bool dumpcontent)
+PrintVisitor::PrintVisitor(CompilationContext &ctx) : ctx(ctx)
 {
-	this->dumpcontent = dumpcontent;
+}
+
+bool PrintVisitor::DumpASTToTextFile(const char *txtfile, ASTNode *root, bool dumpcontent)
+{
+	FILE *fp;
 	if (txtfile) fp = fopen(txtfile, "w"); else fp = stdout;
-	assert(fp);
-	root->Accept(*this);
+	if (!fp) return false;
+	OutputBuffer buf(fp);
+	out = &buf;
+	this->dumpcontent = false;
+	interleave = dumpcontent;
+	if (interleave) {
+		text.clear();
+		notes.clear();
+		Dispatch(root);
+		OutInterleaved();
+	} else {
+		Dispatch(root);
+	}
+	bool ok = buf.Flush();
 	if (txtfile) fclose(fp);
+	return ok;
 }
 
 void PrintVisitor::DumpTree(ASTNode *root, bool dumpcontent)
 {
-	fp = stdout;
+	OutputBuffer buf(stdout);
+	out = &buf;
 	this->dumpcontent = dumpcontent;
-	root->Accept(*this);
+	interleave = false;
+	Dispatch(root);
 }
 
 void PrintVisitor::Visit(ASTNode *node, int level, std::function<void()> func)
 {
-	for (int i = 0; i < (level + 1) * 2; i++) fprintf(fp, ">");
-	fprintf(fp, " ");
-
-	fprintf(fp, "%s [%p]: ", typeid(*node).name(), node);
+	info.clear();
 	func();
-	fprintf(fp, "\n");
 
-	if (dumpcontent) MiniJavaC::Instance()->DumpContent(node->loc, fp);
+	// "%p" is kept so the pointers read the same as in the compiler's other dumps
+	char buf[64];
+	int indent = (level + 1) * 2;
+	if (interleave) {
+		// the line is kept until the source line the node starts on has been written
+		size_t begin = text.size();
+		text.append(indent, '>');
+		text += ' ';
+		text.append(GetKindName(node->kind), GetKindNameLength(node->kind));
+		snprintf(buf, sizeof(buf), " [%p]: ", node);
+		text += buf;
+		text += info;
+		yylinecol loc = ctx.ResolveLocation(node->loc);
+		snprintf(buf, sizeof(buf), " at [(%d,%d):(%d,%d)]\n", loc.first_line, loc.first_column, loc.last_line, loc.last_column);
+		text += buf;
+		notes.push_back(Note { (size_t) loc.first_line, begin, text.size() });
+		VisitChildren(node, level);
+		return;
+	}
+
+	for (int i = 0; i < indent; i++) out->Put('>');
+	out->Put(' ');
+	out->Put(GetKindName(node->kind), GetKindNameLength(node->kind));
+	snprintf(buf, sizeof(buf), " [%p]: ", node);
+	out->Put(buf);
+	out->Put(info.data(), info.size());
+	out->Put('\n');
+
+	if (dumpcontent) {
+		std::string content = ctx.FormatContent(node->loc);
+		out->Put(content.data(), content.size());
+	}
 
 	VisitChildren(node, level);
 }
+
+void PrintVisitor::OutInterleaved()
+{
+	// every source line once, followed by the nodes starting on it in tree order,
+	// a parent starts no later than its children, so the order is nearly sorted already
+	std::stable_sort(notes.begin(), notes.end(), [](const Note &a, const Note &b) { return a.line < b.line; });
+	char buf[16];
+	size_t k = 0;
+	for (size_t i = 1; i <= ctx.GetLineCount(); i++) {
+		size_t len;
+		const char *line = ctx.GetSourceLine(i, len);
+		snprintf(buf, sizeof(buf), "%5u | ", (unsigned) i);
+		out->Put(buf);
+		out->Put(line, len);
+		out->Put('\n');
+		for (; k < notes.size() && notes[k].line <= i; k++) {
+			out->Put(text.data() + notes[k].begin, notes[k].end - notes[k].begin);
+		}
+	}
+	for (; k < notes.size(); k++) {
+		out->Put(text.data() + notes[k].begin, notes[k].end - notes[k].begin);
+	}
+}
+
 void PrintVisitor::Visit(ASTNode *node, int level)
 {
 	Visit(node, level, []{});
@@ -36,36 +106,40 @@ void PrintVisitor::Visit(ASTNode *node, int level)
 void PrintVisitor::Visit(ASTIdentifier *node, int level)
 {
 	Visit(node, level, [&] {
-		fprintf(fp, "identifier=%s", node->id.c_str());
+		info += "identifier=";
+		info += node->id.c_str();
 	});
 }
 void PrintVisitor::Visit(ASTBoolean *node, int level)
 {
 	Visit(node, level, [&] {
-		fprintf(fp, "value=%d", node->val);
+		info += "value=" + std::to_string(node->val);
 	});
 }
 void PrintVisitor::Visit(ASTNumber *node, int level)
 {
 	Visit(node, level, [&] {
-		fprintf(fp, "value=%d", node->val);
+		info += "value=" + std::to_string(node->val);
 	});
 }
 void PrintVisitor::Visit(ASTBinaryExpression *node, int level)
 {
 	Visit(node, level, [&] {
-		fprintf(fp, "operator=%s", node->GetOperatorName());
+		info += "operator=";
+		info += node->GetOperatorName();
 	});
 }
 void PrintVisitor::Visit(ASTUnaryExpression *node, int level)
 {
 	Visit(node, level, [&] {
-		fprintf(fp, "operator=%s", node->GetOperatorName());
+		info += "operator=";
+		info += node->GetOperatorName();
 	});
 }
 void PrintVisitor::Visit(ASTType *node, int level)
 {
 	Visit(node, level, [&] {
-		fprintf(fp, "type=%s", node->GetTypeName());
+		info += "type=";
+		info += node->GetTypeName();
 	});
-}
\ No newline at end of file
+}
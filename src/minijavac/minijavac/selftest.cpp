@@ -0,0 +1,232 @@
+#include "common.h"
+#include "minijavac.tab.h"
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			failures++; \
+		} \
+	} while (0)
+
+// every node class covers its own kind range, and only the ranges of classes derived from it
+static void TestKindRanges()
+{
+	ASTNodePool pool;
+	ASTNodePool::Scope scope(&pool);
+	yyltype loc = {};
+
+	ASTNode *num = new ASTNumber(loc, 1);
+	CHECK(num->Is<ASTNumber>());
+	CHECK(num->Is<ASTExpression>());
+	CHECK(!num->Is<ASTIdentifier>());
+	CHECK(!num->Is<ASTBoolean>());
+	CHECK(!num->Is<ASTType>());
+
+	ASTNode *ident = new ASTIdentifier(loc, Symbol("x"));
+	CHECK(ident->Is<ASTIdentifier>());
+	CHECK(!ident->Is<ASTNumber>());
+	CHECK(!ident->Is<ASTBinaryExpression>());
+
+	ASTNode *bin = new ASTBinaryExpression(loc, { num, ident }, 0);
+	CHECK(bin->Is<ASTBinaryExpression>());
+	CHECK(!bin->Is<ASTUnaryExpression>());
+
+	ASTNode *stmt = new ASTPrintlnStatement(loc, { bin });
+	CHECK(stmt->Is<ASTStatement>());
+	CHECK(!stmt->Is<ASTType>());
+	CHECK(!stmt->Is<ASTExpression>());
+
+	ASTNode *type = new ASTType(loc, {}, ASTType::VT_INT);
+	CHECK(type->Is<ASTType>());
+	CHECK(!type->Is<ASTExpression>());
+}
+
+// FlatASTNode uses the same ranges for Is<T>() and the check in Child<T>()
+static void TestFlatKinds()
+{
+	ASTNodePool pool;
+	ASTNodePool::Scope scope(&pool);
+	yyltype loc = {};
+
+	ASTNode *bin = new ASTBinaryExpression(loc, { new ASTNumber(loc, 1), new ASTIdentifier(loc, Symbol("x")) }, 0);
+	FlatAST flat;
+	flat.Build(new ASTPrintlnStatement(loc, { bin }));
+
+	FlatASTNode<ASTPrintlnStatement> stmt(&flat, FlatAST::ROOT);
+	FlatASTNode<ASTBinaryExpression> fbin = stmt.Child<ASTBinaryExpression>(0);
+	FlatASTNode<ASTExpression> l = fbin.Child<ASTExpression>(0), r = fbin.Child<ASTExpression>(1);
+	CHECK(l.Is<ASTNumber>() && !l.Is<ASTIdentifier>());
+	CHECK(r.Is<ASTIdentifier>() && !r.Is<ASTNumber>());
+	CHECK(!fbin.Is<ASTUnaryExpression>());
+	CHECK(r.GetSymbol() == Symbol("x"));
+}
+
+// FlatAST::Validate() rejects the corruptions ASTCache::Load() must not inflate
+static void TestFlatValidate()
+{
+	ASTNodePool pool;
+	ASTNodePool::Scope scope(&pool);
+	yyltype loc = {};
+
+	FlatAST src;
+	src.Build(new ASTPrintlnStatement(loc, { new ASTBinaryExpression(loc, { new ASTNumber(loc, 1), new ASTIdentifier(loc, Symbol("x")) }, TOK_ADD) }));
+	size_t n = src.size();
+	std::vector<ASTNodeKind> kind(src.kind, src.kind + n);
+	std::vector<yyltype> locs(src.loc, src.loc + n);
+	std::vector<FlatAST::NodeId> first(src.first, src.first + n + 1);
+	std::vector<uint32_t> data(src.data, src.data + n);
+	FlatASTNode<ASTIdentifier> ident(&src, n - 1);
+	CHECK(ident.Is<ASTIdentifier>());
+
+	auto Valid = [&]() {
+		FlatAST flat;
+		flat.Attach(n, kind.data(), locs.data(), first.data(), data.data(), src.symbols);
+		return flat.Validate();
+	};
+	CHECK(Valid());
+
+	FlatAST::NodeId f = first[1];
+	first[1] = 1; // the binary expression as its own child
+	CHECK(!Valid());
+	first[1] = (FlatAST::NodeId) n + 1;
+	CHECK(!Valid());
+	first[1] = f;
+
+	kind[0] = (ASTNodeKind) AST_NODE_KIND_COUNT;
+	CHECK(!Valid());
+	kind[0] = src.kind[0];
+	kind[1] = ASTNodeKind::ASTUnaryExpression; // well formed tree, but not the shape the parser builds
+	CHECK(!Valid());
+	kind[1] = src.kind[1];
+
+	data[ident.id] = (uint32_t) src.symbols.size();
+	CHECK(!Valid());
+	data[ident.id] = src.data[ident.id];
+	CHECK(Valid());
+}
+
+// a list copied from an indexed one and extended indexes only its additions, and finds every name either way
+static void TestChainedIndex()
+{
+	auto Var = [](const std::string &name, data_off_t off) {
+		VarDeclItem item;
+		item.decl.name = Symbol(name);
+		item.off = off;
+		item.size = 4;
+		return item;
+	};
+	VarDeclList base;
+	for (int i = 0; i < 40; i++) {
+		base.Append(Var("v" + std::to_string(i), i * 4));
+	}
+	VarDeclList derived = base, same = base;
+	derived.Replace(derived.Find(Symbol("v3")), Var("v3", 1000));
+	for (int i = 40; i < 45; i++) {
+		derived.Append(Var("v" + std::to_string(i), i * 4));
+	}
+	CHECK(!derived.Append(Var("v7", 0)));
+
+	base.BuildIndex();
+	derived.BuildIndex(&base);
+	same.BuildIndex(&base);
+	bool found = true;
+	for (int i = 0; i < 45; i++) {
+		Symbol name("v" + std::to_string(i));
+		auto it = derived.Find(name);
+		found = found && it != derived.end() && it.GetPosition() == (size_t) i && it->GetName() == name;
+		found = found && (i < 40 ? same.Find(name).GetPosition() == (size_t) i : same.Find(name) == same.end());
+	}
+	CHECK(found);
+	CHECK(derived.Find(Symbol("v3"))->off == 1000);
+	CHECK(base.Find(Symbol("v3"))->off == 12);
+	CHECK(base.Find(Symbol("v40")) == base.end());
+	CHECK(derived.Find(Symbol("w")) == derived.end());
+}
+
+// classes checked on several threads report the same errors in the same order as on one
+static std::string CheckWithJobs(const std::string &src, int jobs, int &errors)
+{
+	CompilationContext cc;
+	cc.log = nullptr;
+	cc.jobs = jobs;
+	cc.LoadBuffer(src.data(), src.size());
+	cc.ParseAST();
+	if (cc.goal) {
+		cc.codegen->GenerateCode(false);
+	}
+	errors = cc.error_count;
+	return cc.diagnostics;
+}
+static void TestParallelCheck()
+{
+	std::string src = "class Main { public static void main(String[] a) { System.out.println(new C0().m(1)); } }\n";
+	for (int c = 0; src.size() < TypeCheck::PARALLEL_MIN_SOURCE * 2; c++) {
+		src += "class C" + std::to_string(c) + " { boolean b; public int m(int y) { int x; x = 0;\n";
+		for (int k = 0; k < 20; k++) {
+			src += "  while (x < y) { x = x + " + std::to_string(k) + "; }\n";
+		}
+		if (c % 7 == 3) src += "  x = b;\n";
+		if (c % 11 == 5) src += "  x = this.nosuch(z);\n";
+		src += "  return x; } }\n";
+	}
+	int serial_errors, parallel_errors;
+	std::string serial = CheckWithJobs(src, 1, serial_errors);
+	std::string parallel = CheckWithJobs(src, 4, parallel_errors);
+	CHECK(serial_errors > 0);
+	CHECK(parallel_errors == serial_errors);
+	CHECK(parallel == serial);
+}
+
+// threads interning the same names in different orders agree on every id,
+// Reset() forgets them, so it runs last
+static void TestSymbolTable()
+{
+	const size_t nname = 20000, nthread = 4;
+	std::vector<std::string> names(nname);
+	for (size_t i = 0; i < nname; i++) {
+		names[i] = "sym" + std::to_string(i);
+	}
+	std::vector<std::vector<uint32_t> > ids(nthread, std::vector<uint32_t>(nname));
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < nthread; t++) {
+		threads.emplace_back([&, t] {
+			for (size_t k = 0; k < nname; k++) {
+				size_t i = t & 1 ? nname - 1 - k : k;
+				ids[t][i] = Symbol(names[i]).GetId();
+			}
+		});
+	}
+	for (auto &th: threads) {
+		th.join();
+	}
+	bool same = true, named = true;
+	for (size_t i = 0; i < nname; i++) {
+		for (size_t t = 1; t < nthread; t++) {
+			same = same && ids[t][i] == ids[0][i];
+		}
+		named = named && ids[0][i] != 0 && Symbol::FromId(ids[0][i]).GetString() == names[i];
+	}
+	CHECK(same);
+	CHECK(named);
+	CHECK(Symbol(names[7]).GetId() == ids[0][7]);
+
+	SymbolTable::Instance()->Reset();
+	CHECK(SymbolTable::Instance()->size() == 1);
+	CHECK(Symbol("sym7").GetString() == "sym7");
+}
+
+int RunSelfTest(int argc, char *argv[])
+{
+	failures = 0;
+	TestKindRanges();
+	TestFlatKinds();
+	TestFlatValidate();
+	TestChainedIndex();
+	TestParallelCheck();
+	TestSymbolTable();
+	printf("self test: %s, %d failure(s)\n", failures ? "FAILED" : "passed", failures);
+	return failures;
+}
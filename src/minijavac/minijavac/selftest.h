@@ -0,0 +1,7 @@
+#pragma once
+
+////////// self test //////////
+
+// minijavac --selftest, checks of compiler internals the test programs can't reach,
+// prints each failure and returns the number of failed checks
+int RunSelfTest(int argc, char *argv[]);
@@ -0,0 +1,215 @@
+#include "common.h"
+
+////////// compile server //////////
+
+CompileServer::CompileServer(const ServerOptions &opt) : opt(opt), listener(INVALID_SOCKET), served(0)
+{
+}
+
+// a SymbolTable over the limit is reset as soon as no compilation uses it, new ones wait for that
+void CompileServer::BeginCompile()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	if (SymbolTable::Instance()->size() > SYMBOL_LIMIT) {
+		drained.wait(guard, [this] { return compiling == 0; });
+		if (SymbolTable::Instance()->size() > SYMBOL_LIMIT) {
+			SymbolTable::Instance()->Reset();
+			if (opt.show_timing) {
+				printf(" [*] Symbol table reset after %u requests\n", (unsigned) served);
+			}
+		}
+	}
+	compiling++;
+}
+void CompileServer::EndCompile()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (--compiling == 0) {
+		drained.notify_all();
+	}
+}
+
+int CompileServer::Compile(uint32_t type, const std::string &outbase, const std::string &payload, ASTNodePool &pool, std::string &log, std::string &outputs)
+{
+	// the context writes its log to a temporary file, which becomes the reply text
+	FILE *fp = tmpfile();
+	if (!fp) {
+		log = "ERROR : Can't create log file.\n";
+		return 1;
+	}
+
+	int errors;
+	BeginCompile();
+	{
+		CompilationContext cc(&pool);
+		cc.show_timing = opt.show_timing;
+		cc.jobs = 1; // the compiles already run side by side
+		cc.log = fp;
+		if (type == SERVER_COMPILE_FILE) {
+			cc.LoadFile(payload.c_str());
+		} else {
+			cc.LoadBuffer(payload.data(), payload.size());
+		}
+		std::string base = outbase.empty() ? "out" : outbase;
+		if (cc.src_loaded) {
+			cc.Compile(base, opt.emit);
+		}
+		errors = cc.error_count;
+		if (errors) {
+			fprintf(fp, "\n%d error(s) occured, compile failed.\n\n", errors);
+		} else {
+			fprintf(fp, "\nCompile successful.\n\n");
+			outputs = GetEmitFiles(base, opt.emit);
+		}
+	}
+	pool.Reset();
+	EndCompile();
+
+	long len = ftell(fp);
+	log.resize(len > 0 ? len : 0);
+	rewind(fp);
+	log.resize(fread(&log[0], 1, log.size(), fp));
+	fclose(fp);
+	return errors;
+}
+
+void CompileServer::Serve(SOCKET s, ASTNodePool &pool)
+{
+	ServerRequestHeader req;
+	while (ServerRecvAll(s, &req, sizeof(req))) {
+		PhaseTimer t;
+		ServerReplyHeader rep = { SERVER_MAGIC, -1, 0, 0 };
+		std::string outbase, payload, log, outputs;
+		bool ok = req.magic == SERVER_MAGIC && req.outbase_len <= MAX_PATH && req.payload_len <= SERVER_MAX_PAYLOAD;
+		if (ok) {
+			outbase.resize(req.outbase_len);
+			payload.resize(req.payload_len);
+			if (!ServerRecvAll(s, &outbase[0], outbase.size()) || !ServerRecvAll(s, &payload[0], payload.size())) {
+				break;
+			}
+		}
+
+		if (ok && (req.type == SERVER_COMPILE_FILE || req.type == SERVER_COMPILE_BUFFER)) {
+			rep.error_count = Compile(req.type, outbase, payload, pool, log, outputs);
+		} else if (ok && req.type == SERVER_SHUTDOWN) {
+			rep.error_count = 0;
+			log = "[*] Server shutting down.\n";
+			Stop();
+		} else {
+			log = "ERROR : malformed request.\n";
+			ok = false;
+		}
+
+		rep.log_len = (uint32_t) log.size();
+		rep.outputs_len = (uint32_t) outputs.size();
+		if (!ServerSendAll(s, &rep, sizeof(rep)) || !ServerSendAll(s, log.data(), log.size()) || !ServerSendAll(s, outputs.data(), outputs.size()) || !ok) {
+			break;
+		}
+		served++;
+		if (opt.show_timing) {
+			printf(" [*] Request %u served in %.3f ms, %d error(s)\n", (unsigned) served, t.Elapsed() * 1000, rep.error_count);
+		}
+	}
+}
+
+void CompileServer::WorkerMain()
+{
+	// the arena of this worker keeps its blocks between requests
+	ASTNodePool pool;
+	while (1) {
+		SOCKET s;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wakeup.wait(guard, [this] { return stopping || !pending.empty(); });
+			if (stopping) return;
+			s = pending.front();
+			pending.pop_front();
+			active.insert(s);
+		}
+		Serve(s, pool);
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			active.erase(s);
+		}
+		closesocket(s);
+	}
+}
+
+void CompileServer::Stop()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (stopping) return;
+	stopping = true;
+	// wake up accept() and every worker blocked in recv(), replies may still be sent
+	shutdown(listener, SD_BOTH);
+	closesocket(listener);
+	for (auto s: active) {
+		shutdown(s, SD_RECEIVE);
+	}
+	for (auto s: pending) {
+		closesocket(s);
+	}
+	pending.clear();
+	wakeup.notify_all();
+}
+
+int CompileServer::Run()
+{
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+		printf("ERROR : WSAStartup failed.\n");
+		return 1;
+	}
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (opt.socket_path.size() >= sizeof(addr.sun_path)) {
+		printf("ERROR : socket path too long.\n");
+		WSACleanup();
+		return 1;
+	}
+	strcpy(addr.sun_path, opt.socket_path.c_str());
+
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener == INVALID_SOCKET) {
+		printf("ERROR : Can't create AF_UNIX socket (%d), Windows 10 1803 or later is required.\n", WSAGetLastError());
+		WSACleanup();
+		return 1;
+	}
+	DeleteFileA(opt.socket_path.c_str()); // a socket file left by a previous server makes bind() fail
+	if (bind(listener, (sockaddr *) &addr, sizeof(addr)) == SOCKET_ERROR || listen(listener, SOMAXCONN) == SOCKET_ERROR) {
+		printf("ERROR : Can't listen on %s (%d).\n", opt.socket_path.c_str(), WSAGetLastError());
+		closesocket(listener);
+		WSACleanup();
+		return 1;
+	}
+
+	size_t nthread = opt.jobs > 0 ? opt.jobs : std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < nthread; i++) {
+		workers.emplace_back(&CompileServer::WorkerMain, this);
+	}
+	printf("[*] Listening on %s with %u workers ...\n", opt.socket_path.c_str(), (unsigned) nthread);
+	fflush(stdout);
+
+	while (1) {
+		SOCKET s = accept(listener, NULL, NULL);
+		std::lock_guard<std::mutex> guard(lock);
+		if (stopping) {
+			if (s != INVALID_SOCKET) closesocket(s);
+			break;
+		}
+		if (s == INVALID_SOCKET) continue;
+		pending.push_back(s);
+		wakeup.notify_one();
+	}
+
+	for (auto &w: workers) {
+		w.join();
+	}
+	DeleteFileA(opt.socket_path.c_str());
+	WSACleanup();
+	printf("[*] Server stopped after %u requests.\n", (unsigned) served);
+	return 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+////////// compile server //////////
+
+class ServerOptions {
+public:
+	std::string socket_path;
+	int jobs = 0; // 0 = one per hardware thread
+	bool show_timing = false;
+	unsigned emit = EMIT_EXE | EMIT_ASM | EMIT_VARS;
+};
+
+// minijavac [--time] [--cache dir] --server <socket> [--jobs n]
+// stays resident and compiles requests from minijavac-client (see serverproto.h),
+// the SymbolTable, the ASTCache and one ASTNodePool per worker stay warm between requests,
+// the SymbolTable is reset between compilations once it holds more than SYMBOL_LIMIT names
+class CompileServer {
+	static const size_t SYMBOL_LIMIT = 1 << 20;
+
+	ServerOptions opt;
+	SOCKET listener;
+	std::mutex lock; // guards pending, active, stopping and compiling
+	std::condition_variable wakeup;
+	std::condition_variable drained; // compiling dropped to 0
+	std::deque<SOCKET> pending; // accepted connections waiting for a worker
+	std::set<SOCKET> active; // connections being served
+	bool stopping = false;
+	size_t compiling = 0; // compilations holding symbols
+	std::atomic<size_t> served;
+private:
+	void BeginCompile();
+	void EndCompile();
+	void WorkerMain();
+	void Serve(SOCKET s, ASTNodePool &pool);
+	int Compile(uint32_t type, const std::string &outbase, const std::string &payload, ASTNodePool &pool, std::string &log, std::string &outputs);
+	void Stop();
+public:
+	CompileServer(const ServerOptions &opt);
+	int Run();
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+// shared by minijavac --server and minijavac-client, include after <windows.h>
+
+#include <winsock2.h>
+#if defined(__has_include)
+#if __has_include(<afunix.h>)
+#include <afunix.h>
+#endif
+#endif
+#ifndef UNIX_PATH_MAX
+// AF_UNIX sockets exist since Windows 10 1803, older SDKs lack the header
+#define UNIX_PATH_MAX 108
+typedef struct sockaddr_un {
+	u_short sun_family;
+	char sun_path[UNIX_PATH_MAX];
+} SOCKADDR_UN;
+#endif
+
+
+//////////////// compile server protocol ////////////////
+
+// a connection carries any number of request/reply pairs, integers are little-endian
+//   request: ServerRequestHeader | outbase | payload
+//   reply:   ServerReplyHeader | log text | output files, each followed by '\n'
+
+#define SERVER_MAGIC 0x31434A4Du // "MJC1"
+
+enum ServerRequestType : uint32_t {
+	SERVER_COMPILE_FILE = 1, // payload is the path of the source file
+	SERVER_COMPILE_BUFFER = 2, // payload is the source text
+	SERVER_SHUTDOWN = 3, // stop accepting connections, no payload
+};
+
+struct ServerRequestHeader {
+	uint32_t magic;
+	uint32_t type;
+	uint32_t outbase_len; // output files are <outbase>.exe, .var.txt, .asm.txt or as set by the server's --emit; empty means "out"
+	uint32_t payload_len;
+};
+
+struct ServerReplyHeader {
+	uint32_t magic;
+	int32_t error_count; // -1 if the request itself was malformed
+	uint32_t log_len; // progress messages and diagnostics, as minijavac prints them
+	uint32_t outputs_len;
+};
+
+static const uint32_t SERVER_MAX_PAYLOAD = 256 * 1024 * 1024;
+
+static inline bool ServerSendAll(SOCKET s, const void *buf, size_t len)
+{
+	const char *p = (const char *) buf;
+	while (len) {
+		int n = send(s, p, (int) std::min<size_t>(len, 1 << 20), 0);
+		if (n <= 0) return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+static inline bool ServerRecvAll(SOCKET s, void *buf, size_t len)
+{
+	char *p = (char *) buf;
+	while (len) {
+		int n = recv(s, p, (int) std::min<size_t>(len, 1 << 20), 0);
+		if (n <= 0) return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
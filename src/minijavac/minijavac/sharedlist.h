@@ -0,0 +1,244 @@
+#pragma once
+
+//////////////// NameIndex ////////////////
+
+// open-addressing index from item name to position, linear probing,
+// interning already numbered every name, so a slot only keeps the symbol id and Find() never reads the items
+class NameIndex {
+	struct Slot {
+		uint32_t id; // symbol id of the name
+		uint32_t pos; // item index + 1, 0 for an empty slot
+	};
+	std::vector<Slot> slots; // empty or a power of two, at most half full
+	size_t count = 0;
+private:
+	static uint32_t Hash(uint32_t id)
+	{
+		return id * 2654435761u;
+	}
+	void Place(const Slot &slot)
+	{
+		size_t mask = slots.size() - 1;
+		size_t i = Hash(slot.id) & mask;
+		while (slots[i].pos) i = (i + 1) & mask;
+		slots[i] = slot;
+	}
+	void Rehash(size_t nslots)
+	{
+		std::vector<Slot> old(nslots, Slot { 0, 0 });
+		slots.swap(old);
+		for (auto &slot: old) {
+			if (slot.pos) Place(slot);
+		}
+	}
+public:
+	// name must not be in the index yet
+	void Insert(Symbol name, size_t pos)
+	{
+		if ((count + 1) * 2 > slots.size()) Rehash(std::max<size_t>(16, slots.size() * 2));
+		Place(Slot { name.GetId(), (uint32_t) pos + 1 });
+		count++;
+	}
+	bool Find(Symbol name, size_t &pos) const
+	{
+		if (slots.empty()) return false;
+		uint32_t id = name.GetId();
+		size_t mask = slots.size() - 1;
+		for (size_t i = Hash(id) & mask; slots[i].pos; i = (i + 1) & mask) {
+			if (slots[i].id == id) {
+				pos = slots[i].pos - 1;
+				return true;
+			}
+		}
+		return false;
+	}
+	size_t size() const { return count; }
+};
+
+
+//////////////// SharedNameIndexedList ////////////////
+
+// NameIndexedList with persistent storage: copies share every node with the original,
+// Append() and Replace() copy only the few nodes on the path to the item they change,
+// so a derived class starts from its base class's members in O(1) and pays only for what it adds,
+// items can't be modified in place, Replace() puts a new version in the same position
+// once a list is complete, BuildIndex() adds flat NameIndexes that Find() uses instead of the trie,
+// a list that starts as a copy of another only indexes what it added and chains to the other's index
+template <class T>
+class SharedNameIndexedList {
+	static const unsigned BITS = 5;
+	static const unsigned WIDTH = 1 << BITS;
+	static const unsigned MASK = WIDTH - 1;
+
+	// the items, a WIDTH-way trie on the position
+	struct ItemNode {
+		std::vector<T> items; // bottom level
+		std::vector<std::shared_ptr<const ItemNode> > children; // other levels
+	};
+	typedef std::shared_ptr<const ItemNode> ItemPtr;
+
+	// the name index, a WIDTH-way trie on the symbol id that only grows a level where two ids share a slot
+	struct IndexNode;
+	struct IndexEntry {
+		uint32_t id;
+		uint32_t pos;
+		std::shared_ptr<const IndexNode> child; // set when the slot is shared
+	};
+	struct IndexNode {
+		uint32_t bitmap = 0; // slots in use
+		std::vector<IndexEntry> entries; // one per slot in use, in slot order
+	};
+	typedef std::shared_ptr<const IndexNode> IndexPtr;
+
+	ItemPtr root;
+	unsigned shift = 0; // BITS * (levels - 1)
+	size_t count = 0;
+	IndexPtr index;
+	// own holds the positions a list added to the one it was copied from, the earlier ones are found in base
+	struct FlatIndex {
+		NameIndex own;
+		std::shared_ptr<const FlatIndex> base;
+	};
+	// built on request, shared by copies and dropped by Append(),
+	// mutable because the items it indexes are shared between lists and can't be modified
+	mutable std::shared_ptr<const FlatIndex> flat;
+private:
+	static unsigned PopCount(uint32_t x)
+	{
+		return (unsigned) std::bitset<32>(x).count();
+	}
+	static ItemPtr SetItem(const ItemNode *node, unsigned s, size_t pos, const T &item)
+	{
+		auto copy = node ? std::make_shared<ItemNode>(*node) : std::make_shared<ItemNode>();
+		size_t i = (pos >> s) & MASK;
+		if (s == 0) {
+			if (i < copy->items.size()) copy->items[i] = item; else copy->items.push_back(item);
+		} else {
+			const ItemNode *child = i < copy->children.size() ? copy->children[i].get() : nullptr;
+			ItemPtr n = SetItem(child, s - BITS, pos, item);
+			if (child) copy->children[i] = std::move(n); else copy->children.push_back(std::move(n));
+		}
+		return copy;
+	}
+	static IndexPtr Insert(const IndexNode *node, unsigned s, uint32_t id, uint32_t pos)
+	{
+		auto copy = node ? std::make_shared<IndexNode>(*node) : std::make_shared<IndexNode>();
+		uint32_t bit = 1u << ((id >> s) & MASK);
+		size_t i = PopCount(copy->bitmap & (bit - 1));
+		if (!(copy->bitmap & bit)) {
+			copy->bitmap |= bit;
+			copy->entries.insert(copy->entries.begin() + i, IndexEntry { id, pos, nullptr });
+		} else {
+			IndexEntry &e = copy->entries[i];
+			if (e.child) {
+				e.child = Insert(e.child.get(), s + BITS, id, pos);
+			} else if (e.id == id) {
+				e.pos = pos;
+			} else {
+				IndexPtr sub = Insert(nullptr, s + BITS, e.id, e.pos);
+				e.child = Insert(sub.get(), s + BITS, id, pos);
+			}
+		}
+		return copy;
+	}
+	bool Lookup(Symbol name, size_t &pos) const
+	{
+		uint32_t id = name.GetId();
+		const IndexNode *node = index.get();
+		for (unsigned s = 0; node; s += BITS) {
+			uint32_t bit = 1u << ((id >> s) & MASK);
+			if (!(node->bitmap & bit)) return false;
+			const IndexEntry &e = node->entries[PopCount(node->bitmap & (bit - 1))];
+			if (!e.child) {
+				pos = e.pos;
+				return e.id == id;
+			}
+			node = e.child.get();
+		}
+		return false;
+	}
+	const T &Get(size_t pos) const
+	{
+		const ItemNode *node = root.get();
+		for (unsigned s = shift; s > 0; s -= BITS) {
+			node = node->children[(pos >> s) & MASK].get();
+		}
+		return node->items[pos & MASK];
+	}
+public:
+	class iterator {
+		const SharedNameIndexedList *list;
+		size_t pos;
+	public:
+		iterator(const SharedNameIndexedList *list, size_t pos) : list(list), pos(pos) {}
+		const T &operator * () const { return list->Get(pos); }
+		const T *operator -> () const { return &list->Get(pos); }
+		iterator &operator ++ () { pos++; return *this; }
+		iterator operator + (ptrdiff_t n) const { return iterator(list, pos + n); }
+		ptrdiff_t operator - (const iterator &r) const { return (ptrdiff_t) pos - (ptrdiff_t) r.pos; }
+		bool operator == (const iterator &r) const { return pos == r.pos; }
+		bool operator != (const iterator &r) const { return pos != r.pos; }
+		size_t GetPosition() const { return pos; }
+	};
+	typedef iterator const_iterator;
+
+	bool Append(const T &item)
+	{
+		size_t pos;
+		if (Lookup(item.GetName(), pos)) return false;
+		if (count && count == (size_t) WIDTH << shift) {
+			auto top = std::make_shared<ItemNode>();
+			top->children.push_back(std::move(root));
+			root = std::move(top);
+			shift += BITS;
+		}
+		root = SetItem(root.get(), shift, count, item);
+		index = Insert(index.get(), 0, item.GetName().GetId(), (uint32_t) count);
+		count++;
+		flat.reset();
+		return true;
+	}
+	// the item at it gets a new version, its name must not change
+	void Replace(iterator it, const T &item)
+	{
+		assert(it->GetName() == item.GetName());
+		root = SetItem(root.get(), shift, it.GetPosition(), item);
+	}
+	iterator Find(Symbol name) const
+	{
+		size_t pos;
+		if (!flat) {
+			return Lookup(name, pos) ? iterator(this, pos) : end();
+		}
+		for (const FlatIndex *idx = flat.get(); idx; idx = idx->base.get()) {
+			if (idx->own.Find(name, pos)) return iterator(this, pos);
+		}
+		return end();
+	}
+	// not thread-safe, call it before the list is read by several threads, a no-op if the index is current,
+	// base is the indexed list this one was copied from, so its items keep their names and positions here
+	void BuildIndex(const SharedNameIndexedList *base = nullptr) const
+	{
+		if (flat) return;
+		size_t first = 0;
+		std::shared_ptr<FlatIndex> idx = std::make_shared<FlatIndex>();
+		if (base && base->flat && base->count <= count) {
+			if (base->count == count) {
+				flat = base->flat;
+				return;
+			}
+			first = base->count;
+			idx->base = base->flat;
+		}
+		for (size_t pos = first; pos < count; pos++) {
+			idx->own.Insert(Get(pos).GetName(), pos);
+		}
+		flat = std::move(idx);
+	}
+	iterator begin() const { return iterator(this, 0); }
+	iterator end() const { return iterator(this, count); }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	const T &operator [] (size_t pos) const { return Get(pos); }
+	const T &back() const { return Get(count - 1); }
+};
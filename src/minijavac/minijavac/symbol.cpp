@@ -0,0 +1,162 @@
+#include "common.h"
+
+//////////////// Symbol ////////////////
+
+Symbol::Symbol(const char *s, size_t len) : id(SymbolTable::Instance()->Intern(s, len))
+{
+}
+Symbol::Symbol(const std::string &s) : Symbol(s.data(), s.length())
+{
+}
+uint32_t Symbol::GetHash() const
+{
+	return SymbolTable::Instance()->GetHash(id);
+}
+const std::string &Symbol::GetString() const
+{
+	return SymbolTable::Instance()->GetString(id);
+}
+
+std::string operator + (const std::string &l, const Symbol &r)
+{
+	return l + r.GetString();
+}
+std::string operator + (const char *l, const Symbol &r)
+{
+	return l + r.GetString();
+}
+std::string operator + (const Symbol &l, const std::string &r)
+{
+	return l.GetString() + r;
+}
+std::string operator + (const Symbol &l, const char *r)
+{
+	return l.GetString() + r;
+}
+
+
+//////////////// SymbolTable ////////////////
+
+SymbolTable::SymbolTable() : count(0)
+{
+	for (auto &chunk: chunks) {
+		chunk.store(nullptr, std::memory_order_relaxed);
+	}
+	Reset();
+}
+SymbolTable::~SymbolTable()
+{
+	for (auto &chunk: chunks) {
+		delete[] chunk.load(std::memory_order_relaxed);
+	}
+}
+SymbolTable *SymbolTable::Instance()
+{
+	static SymbolTable inst;
+	return &inst;
+}
+
+uint32_t SymbolTable::HashString(const char *s, size_t len)
+{
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		h ^= (uint8_t) s[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// the entry is written before the id is stored in a slot, so a thread finding the id
+// under the shard lock, or receiving it from such a thread, also sees the entry
+uint32_t SymbolTable::AddEntry(const char *s, size_t len, uint32_t hash)
+{
+	uint32_t id = count.load(std::memory_order_relaxed);
+	do {
+		if (id >= CAPACITY) return 0;
+	} while (!count.compare_exchange_weak(id, id + 1, std::memory_order_acq_rel));
+
+	std::atomic<Entry *> &slot = chunks[id >> CHUNK_BITS];
+	Entry *chunk = slot.load(std::memory_order_acquire);
+	if (!chunk) {
+		// first id of a chunk, or a thread racing for it, the loser frees its copy
+		Entry *fresh = new Entry[CHUNK_SIZE];
+		if (slot.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel)) {
+			chunk = fresh;
+		} else {
+			delete[] fresh;
+		}
+	}
+	Entry &e = chunk[id & (CHUNK_SIZE - 1)];
+	e.name.assign(s, len);
+	e.hash = hash;
+	return id;
+}
+
+void SymbolTable::Rehash(Shard &shard, size_t nslots)
+{
+	std::vector<uint32_t> old(nslots, 0);
+	old.swap(shard.slots);
+	size_t mask = nslots - 1;
+	for (uint32_t id: old) {
+		if (!id) continue;
+		size_t i = GetEntry(id).hash & mask;
+		while (shard.slots[i]) i = (i + 1) & mask;
+		shard.slots[i] = id;
+	}
+}
+
+void SymbolTable::Reset()
+{
+	for (auto &shard: shards) {
+		std::lock_guard<std::mutex> guard(shard.lock);
+		shard.slots.assign(64, 0);
+		shard.used = 0;
+	}
+	// the first chunk is kept for the symbols interned next
+	for (uint32_t c = 1; c < MAX_CHUNKS; c++) {
+		delete[] chunks[c].exchange(nullptr, std::memory_order_acq_rel);
+	}
+	if (Entry *chunk = chunks[0].load(std::memory_order_acquire)) {
+		for (uint32_t i = 0; i < CHUNK_SIZE; i++) {
+			std::string().swap(chunk[i].name);
+		}
+	}
+	count.store(0, std::memory_order_release);
+	AddEntry("", 0, HashString("", 0)); // id 0
+}
+
+// the slot holding s, or the empty slot it would go to, caller holds the shard lock
+size_t SymbolTable::Probe(const Shard &shard, const char *s, size_t len, uint32_t hash) const
+{
+	const std::vector<uint32_t> &slots = shard.slots;
+	size_t mask = slots.size() - 1;
+	size_t i = hash & mask;
+	while (uint32_t id = slots[i]) {
+		const Entry &e = GetEntry(id);
+		if (e.hash == hash && e.name.length() == len && memcmp(e.name.data(), s, len) == 0) {
+			break;
+		}
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+uint32_t SymbolTable::Intern(const char *s, size_t len)
+{
+	if (len == 0) return 0;
+
+	uint32_t h = HashString(s, len);
+	Shard &shard = GetShard(h);
+	std::lock_guard<std::mutex> guard(shard.lock);
+	size_t i = Probe(shard, s, len, h);
+	if (shard.slots[i]) return shard.slots[i];
+
+	uint32_t id = AddEntry(s, len, h);
+	if (!id) return 0;
+	shard.slots[i] = id;
+	if (++shard.used * 2 > shard.slots.size()) {
+		Rehash(shard, shard.slots.size() * 2);
+	}
+	return id;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+//////////////// Symbol ////////////////
+
+// interned identifier or class name
+// two symbols are equal iff their strings are equal, so compare and hash by id,
+// a non-empty string yields the empty symbol only when the SymbolTable is full
+class Symbol {
+	uint32_t id = 0; // 0 is the empty name
+public:
+	Symbol() {}
+	explicit Symbol(const char *s, size_t len);
+	explicit Symbol(const std::string &s);
+	static Symbol FromId(uint32_t id) { Symbol s; s.id = id; return s; }
+	uint32_t GetId() const { return id; }
+	uint32_t GetHash() const;
+	const std::string &GetString() const;
+	const char *c_str() const { return GetString().c_str(); }
+	bool empty() const { return id == 0; }
+	bool operator == (const Symbol &r) const { return id == r.id; }
+	bool operator != (const Symbol &r) const { return id != r.id; }
+	bool operator < (const Symbol &r) const { return id < r.id; }
+};
+
+std::string operator + (const std::string &l, const Symbol &r);
+std::string operator + (const char *l, const Symbol &r);
+std::string operator + (const Symbol &l, const std::string &r);
+std::string operator + (const Symbol &l, const char *r);
+
+namespace std {
+	template<> struct hash<Symbol> {
+		size_t operator () (const Symbol &s) const { return s.GetId(); }
+	};
+}
+
+
+//////////////// SymbolTable ////////////////
+
+// shared by all compilations in the process, so symbols compare equal across threads
+// the hash slots are split into shards with a lock each, so lexers on different threads
+// rarely wait for each other, looking up an id already handed out needs no lock
+class SymbolTable {
+	struct Entry {
+		std::string name;
+		uint32_t hash;
+	};
+	struct Shard {
+		std::mutex lock; // guards slots
+		std::vector<uint32_t> slots; // open addressing, 0 = empty, otherwise symbol id
+		size_t used = 0;
+	};
+	static const uint32_t CHUNK_BITS = 12;
+	static const uint32_t CHUNK_SIZE = 1 << CHUNK_BITS;
+	static const uint32_t MAX_CHUNKS = 4096;
+	static const uint32_t SHARD_BITS = 4;
+	static const uint32_t SHARD_COUNT = 1 << SHARD_BITS;
+
+	std::atomic<Entry *> chunks[MAX_CHUNKS]; // indexed by symbol id, a chunk never moves once allocated
+	std::atomic<uint32_t> count; // ids handed out, including id 0
+	Shard shards[SHARD_COUNT]; // picked by the top bits of the hash, slots by the low bits
+private:
+	SymbolTable();
+	~SymbolTable();
+	Entry &GetEntry(uint32_t id) const { return chunks[id >> CHUNK_BITS].load(std::memory_order_acquire)[id & (CHUNK_SIZE - 1)]; }
+	Shard &GetShard(uint32_t hash) { return shards[hash >> (32 - SHARD_BITS)]; }
+	uint32_t AddEntry(const char *s, size_t len, uint32_t hash);
+	size_t Probe(const Shard &shard, const char *s, size_t len, uint32_t hash) const;
+	void Rehash(Shard &shard, size_t nslots);
+public:
+	static const size_t CAPACITY = (size_t) CHUNK_SIZE * MAX_CHUNKS;
+
+	static SymbolTable *Instance();
+	static uint32_t HashString(const char *s, size_t len);
+	uint32_t Intern(const char *s, size_t len); // 0 if the table is full
+	// forgets every symbol but the empty one, no Symbol handed out before may be used afterwards
+	// and no other thread may use the table meanwhile
+	void Reset();
+	const std::string &GetString(uint32_t id) const { return GetEntry(id).name; }
+	uint32_t GetHash(uint32_t id) const { return GetEntry(id).hash; }
+	size_t size() const { return count.load(std::memory_order_acquire); }
+};
@@ -0,0 +1,291 @@
+#include "common.h"
+#include "minijavac.tab.h"
+
+////////// TypeCheck //////////
+
+TypeCheck::TypeCheck(CompilationContext &ctx, ClassInfoList &clsinfo) : ctx(ctx), diag(ctx), clsinfo(clsinfo), cur_cls(nullptr), cur_method(nullptr)
+{
+}
+
+TypeInfo TypeCheck::Check(ASTExpression &expr)
+{
+	Dispatch(&expr);
+	return expr.GetTypeInfo();
+}
+void TypeCheck::CheckType(const yyltype &loc, TypeInfo tinfo, TypeInfo expected)
+{
+	if (tinfo != expected && !tinfo.CanCastTo(expected, clsinfo)) {
+		std::string msg = "type mismatch: " + tinfo.GetName() + ", expected " + expected.GetName();
+		diag.ReportError(loc, msg);
+	}
+}
+
+bool TypeCheck::ResolveVar(ASTIdentifier &ident)
+{
+	// the layout CodeGen uses: local-vars right below EBP, [EBP+8] is this and the args follow it,
+	// member-vars follow the vfptr
+	ident.declkind = ASTIdentifier::DECL_NONE;
+	if (cur_cls && cur_method) {
+		auto lvar = cur_method->localvar.Find(ident.id);
+		if (lvar != cur_method->localvar.end()) {
+			BindVar(ident, ASTIdentifier::DECL_LOCAL, *lvar, -cur_method->localvar.GetTotalSize() + lvar->off);
+			return true;
+		}
+		auto avar = cur_method->decl.arg.Find(ident.id);
+		if (avar != cur_method->decl.arg.end()) {
+			BindVar(ident, ASTIdentifier::DECL_ARG, *avar, 0xC + avar->off);
+			return true;
+		}
+		auto mvar = cur_cls->var.Find(ident.id);
+		if (mvar != cur_cls->var.end()) {
+			BindVar(ident, ASTIdentifier::DECL_FIELD, *mvar, 0x4 + mvar->off);
+			return true;
+		}
+	}
+	return false;
+}
+void TypeCheck::BindVar(ASTIdentifier &ident, ASTIdentifier::DeclKind kind, const VarDeclItem &var, data_off_t off)
+{
+	ident.declkind = kind;
+	ident.var = &var;
+	ident.slot_off = off;
+	ident.slot_size = var.size;
+}
+
+
+
+// statment
+void TypeCheck::Visit(ASTArrayAssignStatement *node, int level)
+{
+	CheckType(node->GetASTIdentifier().loc, Check(node->GetASTIdentifier()), TypeInfo { ASTType::VT_INTARRAY });
+	CheckType(node->GetSubscriptASTExpression().loc, Check(node->GetSubscriptASTExpression()), TypeInfo { ASTType::VT_INT });
+	CheckType(node->GetASTExpression().loc, Check(node->GetASTExpression()), TypeInfo { ASTType::VT_INT });
+}
+void TypeCheck::Visit(ASTAssignStatement *node, int level)
+{
+	TypeInfo tinfo = Check(node->GetASTExpression());
+	ASTIdentifier &ident = node->GetASTIdentifier();
+	if (ResolveVar(ident)) {
+		ident.SetTypeInfo(ident.var->decl.type);
+		CheckType(ident.loc, tinfo, ident.var->decl.type);
+	} else {
+		diag.ReportError(node->loc, "undeclared identifier " + ident.id);
+	}
+}
+void TypeCheck::Visit(ASTPrintlnStatement *node, int level)
+{
+	CheckType(node->GetASTExpression().loc, Check(node->GetASTExpression()), TypeInfo { ASTType::VT_INT });
+}
+void TypeCheck::Visit(ASTWhileStatement *node, int level)
+{
+	CheckType(node->GetASTExpression().loc, Check(node->GetASTExpression()), TypeInfo { ASTType::VT_BOOLEAN });
+	Dispatch(&node->GetASTStatement());
+}
+void TypeCheck::Visit(ASTIfElseStatement *node, int level)
+{
+	CheckType(node->GetASTExpression().loc, Check(node->GetASTExpression()), TypeInfo { ASTType::VT_BOOLEAN });
+	Dispatch(&node->GetThenASTStatement());
+	Dispatch(&node->GetElseASTStatement());
+}
+
+// expression
+void TypeCheck::Visit(ASTExpression *node, int level)
+{
+	// CodeGen reports expressions it can't handle
+	VisitChildren(node, level);
+}
+void TypeCheck::Visit(ASTIdentifier *node, int level)
+{
+	if (ResolveVar(*node)) {
+		node->SetTypeInfo(node->var->decl.type);
+	} else {
+		diag.ReportError(node->loc, "undeclared identifier " + node->id);
+	}
+}
+void TypeCheck::Visit(ASTBoolean *node, int level)
+{
+	node->SetTypeInfo(TypeInfo { ASTType::VT_BOOLEAN });
+}
+void TypeCheck::Visit(ASTNumber *node, int level)
+{
+	node->SetTypeInfo(TypeInfo { ASTType::VT_INT });
+}
+void TypeCheck::Visit(ASTBinaryExpression *node, int level)
+{
+	TypeInfo l = Check(node->GetLeftASTExpression());
+	TypeInfo r = Check(node->GetRightASTExpression());
+
+	TypeInfo ltype, rtype, restype; // l/r operand type, result type
+	switch (node->op) {
+		case TOK_LAND:
+			ltype = rtype = restype = TypeInfo { ASTType::VT_BOOLEAN };
+			break;
+		case TOK_LT: // less then
+			ltype = rtype = TypeInfo { ASTType::VT_INT };
+			restype = TypeInfo { ASTType::VT_BOOLEAN };
+			break;
+		case TOK_ADD:
+		case TOK_SUB:
+		case TOK_MUL:
+			ltype = rtype = restype = TypeInfo { ASTType::VT_INT };
+			break;
+		case TOK_LS: // subscript
+			ltype = TypeInfo { ASTType::VT_INTARRAY };
+			rtype = restype = TypeInfo { ASTType::VT_INT };
+			break;
+		default: panic();
+	}
+	CheckType(node->GetRightASTExpression().loc, r, rtype);
+	CheckType(node->GetLeftASTExpression().loc, l, ltype);
+	node->SetTypeInfo(restype);
+}
+void TypeCheck::Visit(ASTUnaryExpression *node, int level)
+{
+	TypeInfo tinfo = Check(node->GetASTExpression());
+	switch (node->op) {
+		case TOK_NOT:
+			CheckType(node->GetASTExpression().loc, tinfo, TypeInfo { ASTType::VT_BOOLEAN });
+			node->SetTypeInfo(TypeInfo { ASTType::VT_BOOLEAN });
+			break;
+		case TOK_LP:
+			node->SetTypeInfo(tinfo);
+			break;
+		default: panic();
+	}
+}
+void TypeCheck::Visit(ASTArrayLengthExpression *node, int level)
+{
+	CheckType(node->GetASTExpression().loc, Check(node->GetASTExpression()), TypeInfo { ASTType::VT_INTARRAY });
+	node->SetTypeInfo(TypeInfo { ASTType::VT_INT });
+}
+void TypeCheck::Visit(ASTFunctionCallExpression *node, int level)
+{
+	ErrFlagObj ef(diag);
+
+	// arguments are evaluated last to first, then the object
+	std::vector<ASTExpression *> args = node->GetArgs();
+	std::vector<TypeInfo> argtypes(args.size());
+	for (size_t i = args.size(); i-- > 0; ) {
+		argtypes[i] = Check(*args[i]);
+	}
+	TypeInfo cls = Check(node->GetASTExpression());
+
+	ASTIdentifier &ident = node->GetASTIdentifier();
+	const MethodDeclItem *method = nullptr;
+	if (cls.type == ASTType::VT_CLASS) {
+		auto cit = clsinfo.Find(cls.clsname);
+		if (cit != clsinfo.end()) {
+			auto mit = cit->method.Find(ident.id);
+			if (mit != cit->method.end()) {
+				method = &*mit;
+				ident.declkind = ASTIdentifier::DECL_METHOD;
+				ident.method = method;
+			} else {
+				diag.ReportError(ident.loc, "no such method", true);
+			}
+		} else {
+			diag.ReportError(node->GetASTExpression().loc, "no such class", true);
+		}
+	} else {
+		diag.ReportError(node->GetASTExpression().loc, "not a class", true);
+	}
+
+	const VarDeclList *marglist = method ? &method->decl.arg : nullptr;
+	if (marglist && marglist->size() == args.size()) {
+		for (auto it = marglist->begin(); it != marglist->end(); ++it) {
+			size_t i = it - marglist->begin();
+			CheckType(args[i]->loc, argtypes[i], it->decl.type);
+		}
+		node->SetTypeInfo(method->decl.rettype);
+	} else {
+		diag.ReportError(node->GetASTArgExpressionList1().loc, "arg number mismatch");
+		node->SetTypeInfo(TypeInfo { ASTType::VT_UNKNOWN });
+	}
+}
+void TypeCheck::Visit(ASTThisExpression *node, int level)
+{
+	if (cur_cls) {
+		node->SetTypeInfo(TypeInfo { ASTType::VT_CLASS, cur_cls->name });
+	} else {
+		diag.ReportError(node->loc, "invalid use of this");
+		node->SetTypeInfo(TypeInfo { ASTType::VT_UNKNOWN });
+	}
+}
+void TypeCheck::Visit(ASTNewIntArrayExpression *node, int level)
+{
+	CheckType(node->GetASTExpression().loc, Check(node->GetASTExpression()), TypeInfo { ASTType::VT_INT });
+	node->SetTypeInfo(TypeInfo { ASTType::VT_INTARRAY });
+}
+void TypeCheck::Visit(ASTNewExpression *node, int level)
+{
+	ASTIdentifier &ident = node->GetASTIdentifier();
+	auto it = clsinfo.Find(ident.id);
+	if (it != clsinfo.end()) {
+		ident.declkind = ASTIdentifier::DECL_CLASS;
+		ident.cls = &*it;
+		node->SetTypeInfo(TypeInfo { ASTType::VT_CLASS, ident.id });
+	} else {
+		diag.ReportError(ident.loc, "undeclared class " + ident.id);
+		node->SetTypeInfo(TypeInfo { ASTType::VT_UNKNOWN });
+	}
+}
+
+
+void TypeCheck::CheckMainMethod(ASTMainClass &maincls)
+{
+	cur_cls = nullptr;
+	cur_method = nullptr;
+	Dispatch(&maincls.GetASTStatement());
+}
+void TypeCheck::CheckClassMethod(const ClassInfoItem &cls, const MethodDeclItem &method)
+{
+	cur_cls = &cls;
+	cur_method = &method;
+	Dispatch(&method.ptr->GetASTStatementList());
+	CheckType(method.ptr->GetASTExpression().loc, Check(method.ptr->GetASTExpression()), method.decl.rettype);
+}
+void TypeCheck::CheckClass(const ClassInfoItem &cls)
+{
+	diag.Log(" [*] Checking class %s ...\n", cls.GetName().c_str());
+	for (auto &method: cls.method) {
+		if (method.clsname == cls.GetName()) {
+			diag.Log("  [*] Checking %s::%s() ...\n", cls.GetName().c_str(), method.GetName().c_str());
+			CheckClassMethod(cls, method);
+		}
+	}
+}
+void TypeCheck::CheckProgram(ASTGoal &goal)
+{
+	ctx.Log("[*] Checking types ...\n");
+
+	ctx.Log(" [*] Checking main() ...\n");
+	CheckMainMethod(goal.GetASTMainClass());
+	diag.Flush();
+
+	// a checker only writes the nodes of the methods its class defines and reads the class list,
+	// starting threads costs more than checking a small source
+	PhaseTimer t;
+	std::vector<std::unique_ptr<TypeCheck> > checkers;
+	for (size_t i = 0; i < clsinfo.size(); i++) {
+		checkers.emplace_back(new TypeCheck(ctx, clsinfo));
+	}
+	size_t nthread = ctx.jobs > 0 ? ctx.jobs : std::thread::hardware_concurrency();
+	if (ctx.GetSourceSize() < PARALLEL_MIN_SOURCE) {
+		nthread = 1;
+	}
+	WorkStealingPool pool(std::min(nthread, checkers.size()));
+	for (size_t i = 0; i < checkers.size(); i++) {
+		TypeCheck *checker = checkers[i].get();
+		const ClassInfoItem *cls = &clsinfo[i];
+		pool.Submit([checker, cls] { checker->CheckClass(*cls); });
+	}
+	pool.Run();
+
+	for (auto &checker: checkers) {
+		checker->diag.Flush();
+	}
+	if (ctx.show_timing) {
+		ctx.Log(" [*] Checked %u classes on %u threads in %.3f ms\n",
+			(unsigned) checkers.size(), (unsigned) pool.GetThreadCount(), t.Elapsed() * 1000);
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+
+
+////////// TypeCheck //////////
+
+// resolves the type of every expression and what every used identifier refers to,
+// and stores both on the nodes, CodeGen then only reads them,
+// each method is checked on its own, the order of classes and methods doesn't matter,
+// so the classes are checked in parallel, each by its own TypeCheck
+class TypeCheck : public ASTStaticVisitor<TypeCheck> {
+	CompilationContext &ctx;
+	DiagnosticBuffer diag; // flushed in class order, the output doesn't depend on the threads
+	ClassInfoList &clsinfo;
+	const ClassInfoItem *cur_cls;
+	const MethodDeclItem *cur_method;
+private:
+	TypeInfo Check(ASTExpression &expr);
+	void CheckType(const yyltype &loc, TypeInfo tinfo, TypeInfo expected);
+
+	// binds a variable name to a local-var, method-arg or member-var, in that order,
+	// and to its slot in the frame or the object, returns false if there is none
+	bool ResolveVar(ASTIdentifier &ident);
+	static void BindVar(ASTIdentifier &ident, ASTIdentifier::DeclKind kind, const VarDeclItem &var, data_off_t off);
+
+public:
+	using ASTStaticVisitor<TypeCheck>::Visit;
+
+	// statment
+	void Visit(ASTArrayAssignStatement *node, int level);
+	void Visit(ASTAssignStatement *node, int level);
+	void Visit(ASTPrintlnStatement *node, int level);
+	void Visit(ASTWhileStatement *node, int level);
+	void Visit(ASTIfElseStatement *node, int level);
+
+	// expression
+	void Visit(ASTExpression *node, int level);
+	void Visit(ASTIdentifier *node, int level);
+	void Visit(ASTBoolean *node, int level);
+	void Visit(ASTNumber *node, int level);
+	void Visit(ASTBinaryExpression *node, int level);
+	void Visit(ASTUnaryExpression *node, int level);
+	void Visit(ASTArrayLengthExpression *node, int level);
+	void Visit(ASTFunctionCallExpression *node, int level);
+	void Visit(ASTThisExpression *node, int level);
+	void Visit(ASTNewIntArrayExpression *node, int level);
+	void Visit(ASTNewExpression *node, int level);
+public:
+	TypeCheck(CompilationContext &ctx, ClassInfoList &clsinfo);
+	void CheckMainMethod(ASTMainClass &maincls);
+	void CheckClassMethod(const ClassInfoItem &cls, const MethodDeclItem &method);
+	void CheckClass(const ClassInfoItem &cls); // every method it defines
+	void CheckProgram(ASTGoal &goal); // main() and every method defined by a class
+
+	static const size_t PARALLEL_MIN_SOURCE = 64 * 1024; // bytes of source, checked on one thread below it
+};
@@ -0,0 +1,120 @@
+#include "common.h"
+
+////////// ArtifactWriter //////////
+
+ArtifactWriter::ArtifactWriter(bool background) : background(background)
+{
+}
+
+ArtifactWriter::~ArtifactWriter()
+{
+	Finish();
+}
+
+void ArtifactWriter::WorkerMain()
+{
+	while (1) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wakeup.wait(guard, [this] { return closing || !jobs.empty(); });
+			if (jobs.empty()) return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		if (!job.write()) {
+			std::lock_guard<std::mutex> guard(lock);
+			failed.push_back(job.file);
+		}
+	}
+}
+
+void ArtifactWriter::Submit(const std::string &file, std::function<bool()> write)
+{
+	if (!background) {
+		if (!write()) failed.push_back(file);
+		return;
+	}
+	std::lock_guard<std::mutex> guard(lock);
+	assert(!closing);
+	jobs.push_back(Job { file, std::move(write) });
+	if (!worker.joinable()) {
+		worker = std::thread(&ArtifactWriter::WorkerMain, this);
+	}
+	wakeup.notify_one();
+}
+
+std::vector<std::string> ArtifactWriter::Finish()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		closing = true;
+		wakeup.notify_one();
+	}
+	if (worker.joinable()) {
+		worker.join();
+	}
+	return std::move(failed);
+}
+
+
+////////// OutputBuffer //////////
+
+// one spare buffer per thread, an OutputBuffer nested inside another allocates its own
+static thread_local std::unique_ptr<char[]> spare_output_buffer;
+
+OutputBuffer::OutputBuffer(FILE *fp) : fp(fp)
+{
+	buf = spare_output_buffer ? spare_output_buffer.release() : new char[SIZE];
+}
+
+OutputBuffer::OutputBuffer(std::string &str) : str(&str)
+{
+	buf = spare_output_buffer ? spare_output_buffer.release() : new char[SIZE];
+}
+
+OutputBuffer::~OutputBuffer()
+{
+	Flush();
+	if (!spare_output_buffer) {
+		spare_output_buffer.reset(buf);
+	} else {
+		delete[] buf;
+	}
+}
+
+void OutputBuffer::Write(const char *s, size_t n)
+{
+	if (str) {
+		str->append(s, n);
+	} else {
+		ok = fwrite(s, 1, n, fp) == n && ok;
+	}
+	drained += n;
+}
+
+void OutputBuffer::Drain()
+{
+	if (len) {
+		Write(buf, len);
+		len = 0;
+	}
+}
+
+void OutputBuffer::PutInt(int64_t v)
+{
+	char tmp[24], *p = tmp + sizeof(tmp);
+	uint64_t u = v < 0 ? 0 - (uint64_t) v : v;
+	do {
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	if (v < 0) *--p = '-';
+	Put(p, tmp + sizeof(tmp) - p);
+}
+
+bool OutputBuffer::Flush()
+{
+	Drain();
+	return (str || fflush(fp) == 0) && ok;
+}
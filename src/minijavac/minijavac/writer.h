@@ -0,0 +1,82 @@
+#pragma once
+
+////////// ArtifactWriter //////////
+
+// one background thread formatting and writing output files in submission order,
+// so listing I/O overlaps with code generation and linking on the submitting thread,
+// a job may only read compiler state that stays unchanged until Finish()
+class ArtifactWriter {
+	struct Job {
+		std::string file;
+		std::function<bool()> write; // false if the file couldn't be opened
+	};
+	std::thread worker; // started by the first Submit()
+	std::mutex lock; // guards jobs, closing and failed
+	std::condition_variable wakeup;
+	std::deque<Job> jobs;
+	bool closing = false;
+	bool background;
+	std::vector<std::string> failed;
+private:
+	void WorkerMain();
+public:
+	ArtifactWriter(bool background = true); // false runs each job inside Submit()
+	~ArtifactWriter();
+	ArtifactWriter(const ArtifactWriter &) = delete;
+	ArtifactWriter &operator = (const ArtifactWriter &) = delete;
+	void Submit(const std::string &file, std::function<bool()> write);
+	std::vector<std::string> Finish(); // waits for every job, returns the files that failed
+};
+
+
+////////// OutputBuffer //////////
+
+// large append-only buffer in front of a FILE * or a string, written out only when full,
+// never seeks, so it streams to pipes and the console as well as to files,
+// the storage is kept per thread and reused by the next OutputBuffer
+class OutputBuffer {
+	static const size_t SIZE = 1 << 20;
+	char *buf;
+	size_t len = 0;
+	size_t drained = 0;
+	FILE *fp = nullptr;
+	std::string *str = nullptr;
+	bool ok = true;
+private:
+	void Drain();
+	void Write(const char *s, size_t n);
+public:
+	OutputBuffer(FILE *fp);
+	OutputBuffer(std::string &str); // appends to str
+	~OutputBuffer();
+	OutputBuffer(const OutputBuffer &) = delete;
+	OutputBuffer &operator = (const OutputBuffer &) = delete;
+
+	void Put(char c)
+	{
+		if (len == SIZE) Drain();
+		buf[len++] = c;
+	}
+	void Put(const char *s, size_t n)
+	{
+		if (len + n > SIZE) {
+			Drain();
+			if (n > SIZE) {
+				Write(s, n);
+				return;
+			}
+		}
+		memcpy(buf + len, s, n);
+		len += n;
+	}
+	void Put(const char *s)
+	{
+		Put(s, strlen(s));
+	}
+	void PutInt(int64_t v);
+	size_t Tell() const // bytes put so far
+	{
+		return drained + len;
+	}
+	bool Flush(); // false if any write failed
+};
@@ -1,4 +1,15 @@
 @echo off
+rem test the compiler built from these sources, not the prebuilt Release\minijavac.exe
+msbuild ..\src\minijavac\minijavac.sln /p:Configuration=Release /p:Platform=x86 /v:minimal /nologo
+if errorlevel 1 (
+  echo BUILD FAILED, run from a Developer Command Prompt for VS 2017
+  pause
+  exit /b 1
+)
+..\src\minijavac\Release\minijavac.exe --selftest
+if errorlevel 1 (
+  echo   SELF TEST FAILED
+)
 for %%f in (*.java) do (
   echo testing %%f
   ..\src\minijavac\Release\minijavac.exe %%f > %%~nf.log